@@ -0,0 +1,381 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PROMPT "sshell@ucd$ "
+#define PROMPT_LENGTH 12
+#define LINE_MAX_LENGTH 512
+#define DEFAULT_LINES 2000
+
+/*
+ * A corpus of command lines to replay
+ */
+struct Corpus {
+	char * name;
+	char ** lines;
+	int numLines;
+};
+
+/*
+ * A running sshell, with its stdin and stdout connected to the harness, and the state of prompt detection on its stdout
+ */
+struct Session {
+	pid_t processID;
+	int input;
+	int output;
+	int promptMatched;
+	int promptFailure[PROMPT_LENGTH];
+};
+
+/*
+ * Synthetic corpora: each one cycles through its sample lines
+ */
+static char * shortLines[] = { "true", "echo hello", "ls", "date", "uname", "echo a b c d e f", NULL };
+static char * pipelineLines[] = {
+	"echo a b c | tr a-z A-Z | cat | cat | wc -c",
+	"ls | sort | head -n 3",
+	"echo hello | cat | cat | cat | cat | cat | cat",
+	"date | sgrep 2 | scount -l",
+	NULL
+};
+static char * builtinLines[] = { "pwd", "cd .", "sls", "autopin", "cd ..", "cd replay-dir", NULL };
+static char * redirectLines[] = { "echo x > out.txt", "echo y >> out.txt", "cat out.txt > copy.txt", "ls >> listing.txt", "echo z>z.txt", NULL };
+static char * errorLines[] = {
+	"| foo", "echo >", "echo a > b | c", "echo \"unterminated", "> out", "a b c d e f g h i j k l m n o p q r", "echo a >>> b", "ls |", NULL
+};
+
+/*
+ * Current time in nanoseconds
+ */
+static long long nowNanoseconds() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/*
+ * Builds a synthetic corpus of numLines lines cycling through the sample lines
+ */
+static struct Corpus syntheticCorpus(char * name, char ** samples, int numLines) {
+	int numSamples = 0;
+	while (samples[numSamples] != NULL) numSamples++;
+
+	struct Corpus corpus = { name, malloc(sizeof(char *) * numLines), numLines };
+	for (int i = 0; i < numLines; i++) corpus.lines[i] = strdup(samples[i % numSamples]);
+	return corpus;
+}
+
+/*
+ * Loads a recorded corpus, one command line per line. Exits if the file cannot be read.
+ */
+static struct Corpus loadCorpus(char * path) {
+	FILE * file = fopen(path, "r");
+	if (file == NULL) {
+		perror(path);
+		exit(1);
+	}
+
+	struct Corpus corpus = { path, NULL, 0 };
+	int capacity = 0;
+	char line[LINE_MAX_LENGTH];
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		char * nl = strchr(line, '\n');
+		if (nl) *nl = '\0';
+
+		/* Recorded sessions may end with exit, which the harness sends itself */
+		if (!strcmp(line, "exit")) continue;
+
+		if (corpus.numLines == capacity) {
+			capacity = capacity ? capacity * 2 : 256;
+			corpus.lines = realloc(corpus.lines, sizeof(char *) * capacity);
+		}
+		corpus.lines[corpus.numLines++] = strdup(line);
+	}
+
+	fclose(file);
+	return corpus;
+}
+
+/*
+ * Starts sshell in a directory, with its stdin and stdout connected to pipes, and its stderr discarded
+ */
+static struct Session startSession(char * sshell, char * directory) {
+	int toShell[2], fromShell[2];
+	if (pipe2(toShell, O_CLOEXEC) || pipe2(fromShell, O_CLOEXEC)) {
+		perror("pipe");
+		exit(1);
+	}
+
+	struct Session session;
+	memset(&session, 0, sizeof(session));
+	session.processID = fork();
+
+	if (session.processID == 0) {
+		int devNull = open("/dev/null", O_WRONLY);
+		dup2(toShell[0], STDIN_FILENO);
+		dup2(fromShell[1], STDOUT_FILENO);
+		dup2(devNull, STDERR_FILENO);
+		if (chdir(directory)) exit(1);
+		execl(sshell, sshell, (char *)NULL);
+		exit(127);
+	}
+
+	close(toShell[0]);
+	close(fromShell[1]);
+	session.input = toShell[1];
+	session.output = fromShell[0];
+
+	/* Failure function of the prompt, to find prompts split across reads */
+	session.promptFailure[0] = 0;
+	for (int i = 1, k = 0; i < PROMPT_LENGTH; i++) {
+		while (k > 0 && PROMPT[i] != PROMPT[k]) k = session.promptFailure[k - 1];
+		if (PROMPT[i] == PROMPT[k]) k++;
+		session.promptFailure[i] = k;
+	}
+
+	return session;
+}
+
+/*
+ * Reads sshell's output until it prints its next prompt. Returns 1 if sshell exited first.
+ */
+static int waitForPrompt(struct Session * session) {
+	char buf[65536];
+
+	while (1) {
+		ssize_t length = read(session->output, buf, sizeof(buf));
+		if (length == -1 && errno == EINTR) continue;
+		if (length <= 0) return 1;
+
+		/* The prompt is the last thing sshell prints before reading a line, so it ends the read */
+		for (ssize_t i = 0; i < length; i++) {
+			while (session->promptMatched > 0 && buf[i] != PROMPT[session->promptMatched]) {
+				session->promptMatched = session->promptFailure[session->promptMatched - 1];
+			}
+			if (buf[i] == PROMPT[session->promptMatched]) session->promptMatched++;
+
+			if (session->promptMatched == PROMPT_LENGTH) {
+				session->promptMatched = 0;
+				return 0;
+			}
+		}
+	}
+}
+
+/*
+ * Escapes a string for use inside a JSON string: quotes, backslashes and control characters. Returns an allocated copy.
+ */
+static char * escapeJSON(char * string) {
+	char * escaped = malloc(strlen(string) * 6 + 1);
+	char * end = escaped;
+
+	for (unsigned char * c = (unsigned char *)string; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\') end += sprintf(end, "\\%c", *c);
+		else if (*c < 0x20) end += sprintf(end, "\\u%04x", *c);
+		else *end++ = *c;
+	}
+
+	*end = '\0';
+	return escaped;
+}
+
+/*
+ * Orders latencies
+ */
+static int compareLatencies(const void * a, const void * b) {
+	long long first = *(const long long *)a, second = *(const long long *)b;
+	return (first > second) - (first < second);
+}
+
+/*
+ * Latency at a percentile of sorted latencies, in microseconds
+ */
+static double percentile(long long * sorted, int count, double fraction) {
+	int index = (int)(fraction * count + 0.999999) - 1;
+	if (index < 0) index = 0;
+	if (index >= count) index = count - 1;
+	return sorted[index] / 1000.0;
+}
+
+/*
+ * Replays a corpus through a fresh sshell, one line at a time, and prints its results as a JSON line on stdout
+ * and as a table row on stderr. Returns 1 if sshell exited before the end of the corpus.
+ */
+static int replayCorpus(char * sshell, char * directory, struct Corpus * corpus, char * label) {
+	struct Session session = startSession(sshell, directory);
+	long long * latencies = malloc(sizeof(long long) * (corpus->numLines > 0 ? corpus->numLines : 1));
+	int completed = 0;
+
+	if (!waitForPrompt(&session)) {
+		long long start = nowNanoseconds();
+
+		/* A command's latency runs from sending its line to sshell's next prompt */
+		for (; completed < corpus->numLines; completed++) {
+			char line[LINE_MAX_LENGTH + 1];
+			int length = snprintf(line, sizeof(line), "%s\n", corpus->lines[completed]);
+			long long sent = nowNanoseconds();
+
+			if (write(session.input, line, length) != length || waitForPrompt(&session)) break;
+			latencies[completed] = nowNanoseconds() - sent;
+		}
+
+		long long elapsed = nowNanoseconds() - start;
+		qsort(latencies, completed, sizeof(long long), compareLatencies);
+
+		double seconds = elapsed / 1e9;
+		double rate = seconds > 0 ? completed / seconds : 0;
+		double p50 = completed ? percentile(latencies, completed, 0.50) : 0;
+		double p99 = completed ? percentile(latencies, completed, 0.99) : 0;
+		double p999 = completed ? percentile(latencies, completed, 0.999) : 0;
+		double max = completed ? latencies[completed - 1] / 1000.0 : 0;
+
+		char * jsonLabel = escapeJSON(label), * jsonName = escapeJSON(corpus->name);
+		printf("{\"label\":\"%s\",\"time\":%lld,\"corpus\":\"%s\",\"commands\":%d,\"seconds\":%.6f,"
+			"\"commands_per_sec\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f}\n",
+			jsonLabel, (long long)time(NULL), jsonName, completed, seconds, rate, p50, p99, p999, max);
+		free(jsonLabel);
+		free(jsonName);
+		fprintf(stderr, "%-12s %8d %10.1f %10.1f %10.1f %10.1f %10.1f\n", corpus->name, completed, rate, p50, p99, p999, max);
+		fflush(stdout);
+	}
+
+	/* End the session, which also exercises the exit builtin */
+	if (write(session.input, "exit\n", 5) != 5) kill(session.processID, SIGTERM);
+	close(session.input);
+	while (waitForPrompt(&session) == 0);
+	close(session.output);
+	waitpid(session.processID, NULL, 0);
+	free(latencies);
+
+	return completed < corpus->numLines;
+}
+
+/*
+ * Runs a corpus as a script: sshell reads the whole corpus from a file, as it does for scripts, so that it can parse ahead.
+ * Prints the results as a JSON line on stdout and as a table row on stderr, without per-command latencies.
+ * Returns 1 if sshell failed.
+ */
+static int replayScript(char * sshell, char * directory, struct Corpus * corpus, char * label) {
+	char script[PATH_MAX];
+	snprintf(script, sizeof(script), "%s/../script.txt", directory);
+
+	FILE * file = fopen(script, "w");
+	if (file == NULL) {
+		perror(script);
+		return 1;
+	}
+	for (int i = 0; i < corpus->numLines; i++) fprintf(file, "%s\n", corpus->lines[i]);
+	fclose(file);
+
+	long long start = nowNanoseconds();
+	pid_t processID = fork();
+
+	if (processID == 0) {
+		int input = open(script, O_RDONLY);
+		int devNull = open("/dev/null", O_WRONLY);
+		dup2(input, STDIN_FILENO);
+		dup2(devNull, STDOUT_FILENO);
+		dup2(devNull, STDERR_FILENO);
+		if (chdir(directory)) exit(1);
+		execl(sshell, sshell, (char *)NULL);
+		exit(127);
+	}
+
+	int status;
+	waitpid(processID, &status, 0);
+	double seconds = (nowNanoseconds() - start) / 1e9;
+	double rate = seconds > 0 ? corpus->numLines / seconds : 0;
+
+	char * jsonLabel = escapeJSON(label), * jsonName = escapeJSON(corpus->name);
+	printf("{\"label\":\"%s\",\"time\":%lld,\"corpus\":\"%s\",\"mode\":\"script\",\"commands\":%d,\"seconds\":%.6f,"
+		"\"commands_per_sec\":%.1f}\n", jsonLabel, (long long)time(NULL), jsonName, corpus->numLines, seconds, rate);
+	free(jsonLabel);
+	free(jsonName);
+	fprintf(stderr, "%-12s %8d %10.1f %10s %10s %10s %10s\n", corpus->name, corpus->numLines, rate, "-", "-", "-", "-");
+	fflush(stdout);
+
+	unlink(script);
+	return !WIFEXITED(status) || WEXITSTATUS(status);
+}
+
+/*
+ * Session-replay benchmark: replay [-n lines] [-l label] [-s] sshell [corpus...]
+ * Replays each recorded corpus, or the synthetic corpora by default, through sshell in non-interactive mode,
+ * one line at a time, or as a whole script with -s.
+ */
+int main(int argc, char * argv[]) {
+	int numLines = DEFAULT_LINES;
+	char * label = "";
+	int scriptMode = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:l:s")) != -1) {
+		if (opt == 'n') numLines = atoi(optarg);
+		else if (opt == 'l') label = optarg;
+		else if (opt == 's') scriptMode = 1;
+		else {
+			fprintf(stderr, "Usage: %s [-n lines] [-l label] [-s] sshell [corpus...]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind >= argc || numLines <= 0) {
+		fprintf(stderr, "Usage: %s [-n lines] [-l label] [-s] sshell [corpus...]\n", argv[0]);
+		return 1;
+	}
+
+	/* Run sshell by absolute path, from a scratch directory holding the files that corpora create */
+	char * sshell = realpath(argv[optind], NULL);
+	char directory[] = "/tmp/sshell-replay.XXXXXX";
+	if (sshell == NULL || mkdtemp(directory) == NULL) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	/* Sessions start in a subdirectory, which the builtins corpus leaves and re-enters with cd */
+	char scratch[sizeof(directory) + 16];
+	snprintf(scratch, sizeof(scratch), "%s/replay-dir", directory);
+	mkdir(scratch, 0755);
+
+	struct Corpus corpora[64];
+	int numCorpora = 0;
+	if (optind + 1 < argc) {
+		for (int i = optind + 1; i < argc && numCorpora < 64; i++) corpora[numCorpora++] = loadCorpus(argv[i]);
+	}
+	else {
+		corpora[numCorpora++] = syntheticCorpus("short", shortLines, numLines);
+		corpora[numCorpora++] = syntheticCorpus("pipelines", pipelineLines, numLines);
+		corpora[numCorpora++] = syntheticCorpus("builtins", builtinLines, numLines);
+		corpora[numCorpora++] = syntheticCorpus("redirects", redirectLines, numLines);
+		corpora[numCorpora++] = syntheticCorpus("errors", errorLines, numLines);
+	}
+
+	fprintf(stderr, "%-12s %8s %10s %10s %10s %10s %10s\n", "corpus", "commands", "cmds/sec", "p50 us", "p99 us", "p999 us", "max us");
+
+	int failed = 0;
+	for (int i = 0; i < numCorpora; i++) {
+		int exited = scriptMode ? replayScript(sshell, scratch, &corpora[i], label) : replayCorpus(sshell, scratch, &corpora[i], label);
+		if (exited) {
+			fprintf(stderr, "%s: sshell exited early\n", corpora[i].name);
+			failed = 1;
+		}
+	}
+
+	/* Remove the scratch directory */
+	char command[sizeof(directory) + 16];
+	snprintf(command, sizeof(command), "rm -rf %s", directory);
+	if (system(command)) failed = 1;
+
+	free(sshell);
+	return failed;
+}
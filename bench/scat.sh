@@ -0,0 +1,32 @@
+#!/bin/sh
+# Times the scat builtin against cat, through sshell, for a file copied to a file, appended to a file, and sent through a pipe.
+# Usage: bench/scat.sh [megabytes]    (run from the repository root after building sshell)
+# The input is generated once as ${SCAT_BENCH_FILE:-/tmp/scat-bench.bin}, and copies are written next to it.
+
+SIZE_MB=${1:-4096}
+INPUT=${SCAT_BENCH_FILE:-/tmp/scat-bench.bin}
+OUTPUT=$INPUT.out
+SSHELL=${SSHELL:-./sshell}
+
+if [ ! -f "$INPUT" ] || [ "$(stat -c %s "$INPUT")" -lt $((SIZE_MB * 1048576)) ]; then
+	head -c $((SIZE_MB * 1048576)) /dev/urandom > "$INPUT"
+fi
+
+# Elapsed wall-clock seconds of a single command line run through sshell, with the input already in the page cache,
+# and the copy removed beforehand
+elapsed() {
+	rm -f "$OUTPUT"
+	start=$(date +%s.%N)
+	printf '%s\nexit\n' "$1" | $SSHELL > /dev/null 2>&1
+	end=$(date +%s.%N)
+	awk "BEGIN { printf \"%.3f s  %7.0f MB/s\", $end - $start, $SIZE_MB / ($end - $start) }"
+}
+
+cat "$INPUT" > /dev/null
+for command in cat scat; do
+	printf '%-28s %s\n' "$command > file" "$(elapsed "$command $INPUT > $OUTPUT")"
+	printf '%-28s %s\n' "$command >> file" "$(elapsed "$command $INPUT >> $OUTPUT")"
+	printf '%-28s %s\n' "$command | scount -c" "$(elapsed "$command $INPUT | scount -c")"
+	printf '%-28s %s\n' "$command | cat > /dev/null" "$(elapsed "$command $INPUT | cat > /dev/null")"
+done
+rm -f "$OUTPUT"
@@ -0,0 +1,41 @@
+#!/bin/sh
+# Times the sdu builtin on a synthetic tree, for several thread counts, against du.
+# Usage: bench/sdu.sh [files] [threads...]    (run from the repository root after building sshell)
+# The tree is built once under ${SDU_BENCH_DIR:-/tmp/sdu-bench}, with 1000 files per directory.
+
+FILES=${1:-1000000}
+[ $# -gt 0 ] && shift
+THREADS=${*:-"1 2 4 8 16"}
+TREE=${SDU_BENCH_DIR:-/tmp/sdu-bench}
+SSHELL=${SSHELL:-./sshell}
+
+# Build the tree: 10 top-level directories, each holding FILES/10000 subdirectories of 1000 small files
+if [ ! -f "$TREE/.files-$FILES" ]; then
+	rm -rf "$TREE"
+	mkdir -p "$TREE"
+	python3 - "$TREE" "$FILES" <<'PY'
+import os, sys
+root, files = sys.argv[1], int(sys.argv[2])
+for n in range(files):
+    d = os.path.join(root, "d%d" % (n % 10), "s%d" % (n // 10000))
+    if n % 10000 < 10:
+        os.makedirs(d, exist_ok=True)
+    with open(os.path.join(d, "f%d" % n), "w") as f:
+        f.write("x" * (n % 4096))
+PY
+	touch "$TREE/.files-$FILES"
+fi
+
+# Elapsed wall-clock seconds of a command, with the page and dentry caches already warm
+elapsed() {
+	start=$(date +%s.%N)
+	"$@" > /dev/null 2>&1
+	end=$(date +%s.%N)
+	awk "BEGIN { printf \"%.3f\", $end - $start }"
+}
+
+elapsed du -sb "$TREE" > /dev/null
+printf '%-12s %s\n' "du -sb" "$(elapsed du -sb "$TREE")"
+for t in $THREADS; do
+	printf '%-12s %s\n' "sdu -j $t" "$(elapsed sh -c "printf 'sdu -j $t $TREE\nexit\n' | $SSHELL")"
+done
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Compares running a command through a fresh sshell process per invocation against the command server mode.
+# Usage: bench/serve.sh [invocations] [command line]    (run from the repository root after building sshell and sshellc)
+
+COUNT=${1:-2000}
+LINE=${2:-true}
+SSHELL=${SSHELL:-./sshell}
+SSHELLC=${SSHELLC:-./sshellc}
+SOCKET=${SERVE_BENCH_SOCKET:-/tmp/sshell-bench.sock}
+SCRIPT=$(mktemp)
+
+printf '%s\nexit\n' "$LINE" > "$SCRIPT"
+"$SSHELL" --serve "$SOCKET" 2> /dev/null &
+SERVER=$!
+trap 'kill $SERVER; rm -f "$SCRIPT" "$SOCKET"' EXIT
+while [ ! -S "$SOCKET" ]; do sleep 0.01; done
+
+# Elapsed wall-clock seconds and invocations per second of a loop
+report() {
+	awk "BEGIN { printf \"%-28s %8.3f s %10.0f/s\n\", \"$1\", $3 - $2, $COUNT / ($3 - $2) }"
+}
+
+start=$(date +%s.%N)
+i=0; while [ $i -lt "$COUNT" ]; do "$SSHELL" < "$SCRIPT" > /dev/null 2>&1; i=$((i + 1)); done
+report "fresh sshell per command" "$start" "$(date +%s.%N)"
+
+start=$(date +%s.%N)
+i=0; while [ $i -lt "$COUNT" ]; do "$SSHELLC" "$SOCKET" "$LINE" > /dev/null 2>&1; i=$((i + 1)); done
+report "sshellc per command" "$start" "$(date +%s.%N)"
+
+start=$(date +%s.%N)
+i=0; while [ $i -lt "$COUNT" ]; do echo "$LINE"; i=$((i + 1)); done | "$SSHELLC" "$SOCKET" > /dev/null 2>&1
+report "sshellc, one session" "$start" "$(date +%s.%N)"
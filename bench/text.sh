@@ -0,0 +1,47 @@
+#!/bin/sh
+# Times the scount and sgrep builtins, with every SIMD level, against wc and grep -F on a large text file.
+# grep writes through a pipe, because it stops at the first match when its output is /dev/null.
+# Usage: bench/text.sh [megabytes]    (run from the repository root after building sshell)
+# The input is generated once as ${TEXT_BENCH_FILE:-/tmp/text-bench.txt}.
+
+SIZE_MB=${1:-4096}
+INPUT=${TEXT_BENCH_FILE:-/tmp/text-bench.txt}
+SSHELL=${SSHELL:-./sshell}
+
+# Build the input from repeated lines of words, with a rare line holding the pattern
+if [ ! -f "$INPUT" ] || [ "$(stat -c %s "$INPUT")" -lt $((SIZE_MB * 1048576)) ]; then
+	python3 - "$INPUT" "$SIZE_MB" <<'PY'
+import random, sys
+path, size = sys.argv[1], int(sys.argv[2]) << 20
+random.seed(0)
+words = ["alpha", "beta", "gamma", "delta", "epsilon", "zeta", "eta", "theta"]
+block = "".join(" ".join(random.choice(words) for _ in range(random.randint(1, 16))) + "\n" for _ in range(20000))
+block += "a line with the needle in it\n"
+with open(path, "w") as f:
+    for _ in range(size // len(block) + 1):
+        f.write(block)
+PY
+fi
+
+# Elapsed wall-clock seconds of a command, with the input already in the page cache
+elapsed() {
+	start=$(date +%s.%N)
+	"$@" > /dev/null 2>&1
+	end=$(date +%s.%N)
+	awk "BEGIN { printf \"%.3f\", $end - $start }"
+}
+
+# Runs a single command line through sshell, with the given SIMD level
+sshell_line() {
+	SSHELL_SIMD=$1 sh -c "printf '%s\nexit\n' '$2' | $SSHELL"
+}
+
+cat "$INPUT" > /dev/null
+printf '%-28s %s\n' "wc" "$(elapsed wc "$INPUT")"
+printf '%-28s %s\n' "grep -cF needle" "$(elapsed sh -c "grep -cF needle $INPUT | cat")"
+printf '%-28s %s\n' "cat | wc -l" "$(elapsed sh -c "cat $INPUT | wc -l")"
+for simd in scalar sse2 avx2; do
+	printf '%-28s %s\n' "scount ($simd)" "$(elapsed sshell_line $simd "scount $INPUT")"
+	printf '%-28s %s\n' "sgrep -c needle ($simd)" "$(elapsed sshell_line $simd "sgrep -c needle $INPUT")"
+	printf '%-28s %s\n' "cat | scount -l ($simd)" "$(elapsed sshell_line $simd "cat $INPUT | scount -l")"
+done
@@ -1,156 +1,189 @@
 #include "sshell_utils.h"
 
-int main(void)
+/*
+ * Runs a single parsed command line, printing its completed message.
+ * Stores the exit status of every command in statuses, and returns 1 if the shell should exit.
+ */
+int executeParsedLine(struct ParsedLine * line, int statuses[], int * numStatuses)
 {
-	//Original command, and command with all instances of >> replaced with an append character and a space
-	char cmd[CMDLINE_MAX];
-	char parsedCmd[CMDLINE_MAX];
+	//The user's original command, which will be output when the current command finishes execution
+	char * cmd = line->cmd;
+	*numStatuses = 0;
+
+	//Error handling: print an appropriate error message and discard current input if an error occurs
+	if (line->parseRetval != NO_ERRORS) {
+		switch (line->parseRetval) {
+			case MISSING_COMMAND:
+				fprintf(stderr, "Error: missing command\n");
+				break;
+			case NO_OUTPUT_FILE:
+				fprintf(stderr, "Error: no output file\n");
+				break;
+			case MISPLACED_REDIRECT:
+				fprintf(stderr, "Error: mislocated output redirection\n");
+				break;
+			case TOO_MANY_ARGUMENTS:
+				fprintf(stderr, "Error: too many process arguments\n");
+				break;
+		}
 
-	//Event loop scanning for user inputs
-	while (1) {
-		/* Print prompt */
-		printf("sshell@ucd$ ");
-		fflush(stdout);
+		return 0;
+	}
 
-		/* Get command line */
-		fgets(cmd, CMDLINE_MAX, stdin);
+	//Lines of only whitespace were discarded without parsing
+	if (line->parameters == NULL) return 0;
 
-		/* Print command line if stdin is not provided by terminal */
-		if (!isatty(STDIN_FILENO)) {
-			printf("%s", cmd);
-			fflush(stdout);
-		}
+	struct Parameter ** parameters = line->parameters;
+	char * redirects = line->redirects;
+	int parameterCount = line->parameterCount;
 
-		/* Remove trailing newline from command line */
-		char *nl;
-		nl = strchr(cmd, '\n');
-		if (nl) *nl = '\0';
+	//Builtin exit command
+	if (!strcmp(parameters[0]->parameterName, "exit")) {
+		fprintf(stderr, "Bye...\n+ completed '%s' [0]\n", cmd);
+		statuses[0] = 0;
+		*numStatuses = 1;
+		return 1;
+	}
 
-		//If the user entered only whitespace, discard the input without parsing and continue to the next input
-		if (isEmptyCommand(cmd)) continue;
-
-		//Store the user's original command, which will be output when the current command finishes execution.
-		//Make a copy into parsedCmd, which will be edited by parseAppends, where all >> will be replaced.
-		memcpy(parsedCmd, cmd, CMDLINE_MAX);
-
-		//Get an array of Parameters and an array of pipes and file redirects
-		struct Parameter ** parameters;
-		char * redirects;
-		char ** argArray;
-		int parameterCount;
-
-		int parseRetval = getParametersAndRedirects(parsedCmd, &parameters, &redirects, &argArray, &parameterCount);
-
-		//Error handling: print an appropriate error message and discard current input if an error occurs
-		if (parseRetval != NO_ERRORS) {
-			switch (parseRetval) {
-				case MISSING_COMMAND:
-					fprintf(stderr, "Error: missing command\n");
-					break;
-				case NO_OUTPUT_FILE:
-					fprintf(stderr, "Error: no output file\n");
-					break;
-				case MISPLACED_REDIRECT:
-					fprintf(stderr, "Error: mislocated output redirection\n");
-					break;
-				case TOO_MANY_ARGUMENTS:
-					fprintf(stderr, "Error: too many process arguments\n");
-					break;
-			}
+	//Builtins that run inside the shell itself
+	int isBuiltin = 1;
+	int retval = 0;
 
-			//No parameters are created in the case of a parsing error, so nothing needs to be freed
-			continue;
+	//Builtin cd command
+	if (!strcmp(parameters[0]->parameterName, "cd")) {
+		retval = cd(parameters[0]);
+	}
+
+	//Builtin sls command
+	else if (!strcmp(parameters[0]->parameterName, "sls")) {
+		retval = sls();
+	}
+
+	//Builtin pwd command
+	else if (!strcmp(parameters[0]->parameterName, "pwd")) {
+		retval = pwd();
+	}
+
+	//Builtin autopin command
+	else if (!strcmp(parameters[0]->parameterName, "autopin")) {
+		retval = autopin(parameters[0]);
+	}
+
+	else isBuiltin = 0;
+
+	if (isBuiltin) {
+		fprintf(stderr, "+ completed '%s' [%d]\n", cmd, retval);
+		statuses[0] = retval;
+		*numStatuses = 1;
+		return 0;
+	}
+	
+	//Determine output mode depending on the last redirect in the redirect array, with stdout by default
+	int outputMode = WRITE_TO_STDOUT;
+	if (parameterCount > 1) {
+		if (redirects[parameterCount-2] == APPEND) {
+			outputMode = APPEND_TO_FILE;
 		}
 
-		//Builtin exit command
-		if (!strcmp(parameters[0]->parameterName, "exit")) {
-			//No memory deallocation is needed, as program immediately exists anyways
-			fprintf(stderr, "Bye...\n+ completed '%s' [0]\n", cmd);
-			break;
+		else if (redirects[parameterCount-2] == OVERWRITE) {
+			outputMode = WRITE_TO_FILE;
 		}
+	}
+
+	//If a file redirect is detected, set the output file to the final parameter's name.
+	char * outputFile = NULL;
+	if (outputMode != WRITE_TO_STDOUT) {
+		outputFile = parameters[parameterCount-1]->parameterName;
 
-		//Builtin cd command
-		if (!strcmp(parameters[0]->parameterName, "cd")) {
-			int retval = cd(parameters[0]);
+		//Because the final parameter is a file, do not count it in the pipeline execution.
+		parameterCount--;
+	}
 
-			//Free the parameters, redirect array, and argument array
-			freeParameterArray(parameters);
-			free(redirects);
-			freeArgArray(argArray);
+	//Builtin memo command, which replays the cached output of the pipeline when its inputs are unchanged
+	if (!strcmp(parameters[0]->parameterName, "memo")) {
+		*numStatuses = memo(parameters, parameterCount, outputMode, outputFile, cmd, statuses);
+	}
 
-			fprintf(stderr, "+ completed '%s' [%d]\n", cmd, retval);
-			continue;
+	//Builtin bench command, which runs pipelines repeatedly and prints statistics of their times
+	else if (!strcmp(parameters[0]->parameterName, "bench")) {
+		*numStatuses = bench(parameters, parameterCount, outputMode, outputFile, cmd, statuses);
+	}
+
+	//Execute the pipeline, with its output sent to either stdout or a file
+	else {
+		int waitStatuses[parameterCount];
+		if (!executePipeline(parameters, parameterCount, outputMode, outputFile, cmd, waitStatuses)) {
+			for (int i = 0; i < parameterCount; i++) {
+				statuses[i] = WEXITSTATUS(waitStatuses[i]);
+			}
+			*numStatuses = parameterCount;
 		}
+	}
 
-		//Builtin sls command
-		if (!strcmp(parameters[0]->parameterName, "sls")) {
-			int retval = sls();
+	return 0;
+}
 
-			//Free the parameters, redirect array, and argument array
-			freeParameterArray(parameters);
-			free(redirects);
-			freeArgArray(argArray);
+/*
+ * Parses and runs a single command line, printing its completed message.
+ * Stores the exit status of every command in statuses, and returns 1 if the shell should exit.
+ */
+int executeCommandLine(char cmd[], int statuses[], int * numStatuses)
+{
+	struct ParsedLine line;
+	parseCommandLine(cmd, &line);
 
-			fprintf(stderr, "+ completed '%s' [%d]\n", cmd, retval);
-			continue;
-		}
+	int exitRequested = executeParsedLine(&line, statuses, numStatuses);
 
-		//Builtin pwd command
-		if (!strcmp(parameters[0]->parameterName, "pwd")) {
-			int retval = pwd();
+	//Free the parameters, redirect array, and argument array
+	freeParsedLine(&line);
+	return exitRequested;
+}
 
-			//Free the parameters, redirect array, and argument array
-			freeParameterArray(parameters);
-			free(redirects);
-			freeArgArray(argArray);
+int main(int argc, char * argv[])
+{
+	//Command server mode, where command lines are received from clients over a Unix socket
+	if (argc == 3 && !strcmp(argv[1], "--serve")) {
+		return serveCommands(argv[2]);
+	}
 
-			fprintf(stderr, "+ completed '%s' [%d]\n", cmd, retval);
-			continue;
-		}
-		
-		//Determine output mode depending on the last redirect in the redirect array, with stdout by default
-		int outputMode = WRITE_TO_STDOUT;
-		if (parameterCount > 1) {
-			if (redirects[parameterCount-2] == APPEND) {
-				outputMode = APPEND_TO_FILE;
-			}
+	//Original command entered by the user
+	char cmd[CMDLINE_MAX];
 
-			else if (redirects[parameterCount-2] == OVERWRITE) {
-				outputMode = WRITE_TO_FILE;
-			}
-		}
+	//Exit statuses of the commands of the last command line
+	int statuses[MAX_ARGUMENTS];
+	int numStatuses;
 
-		//If a file redirect is detected, set the output file to the final parameter's name.
-		char * outputFile = NULL;
-		if (outputMode != WRITE_TO_STDOUT) {
-			outputFile = parameters[parameterCount-1]->parameterName;
+	//Scripts and other input not provided by a terminal are parsed ahead of the running pipeline
+	int batchMode = !isatty(STDIN_FILENO);
+	if (batchMode) startLookAhead();
 
-			//Because the final parameter is a file, do not count it in the pipeline execution.
-			parameterCount--;
-		}
+	//Event loop scanning for user inputs
+	while (1) {
+		/* Print prompt */
+		printf("sshell@ucd$ ");
+		fflush(stdout);
 
-		//Fork the current execution, with the child executing the pipeline.
-		//This is so the child can set output to either stdout or a file, without influencing future commands.
-		if (fork()) {
-			//Wait for child to finish execution
-			int retval;
-			wait(&retval);
-		} else {
-			//Try to set file output- if it fails, print an error message and exit
-			if (stdoutRedirect(outputMode, outputFile)) {
-				fprintf(stderr, "Error: cannot open output file\n");
-				exit(1);
-			}
+		/* In batch mode, take the next line, usually already parsed while the previous pipeline ran, and print it */
+		if (batchMode) {
+			struct ParsedLine * line = nextLookAheadLine();
+			if (line == NULL) break;
+
+			printf("%s", line->input);
+			fflush(stdout);
 
-			//Execute the pipeline and exit the child process
-			executePipeline(parameters, parameterCount, cmd);
-			exit(0);
+			if (executeParsedLine(line, statuses, &numStatuses)) break;
+			continue;
 		}
 
-		//Free the parameters, redirect array, and argument array
-		freeParameterArray(parameters);
-		free(redirects);
-		freeArgArray(argArray);
+		/* Get command line, and exit at the end of the input */
+		if (fgets(cmd, CMDLINE_MAX, stdin) == NULL) break;
+
+		/* Remove trailing newline from command line */
+		char *nl;
+		nl = strchr(cmd, '\n');
+		if (nl) *nl = '\0';
+
+		if (executeCommandLine(cmd, statuses, &numStatuses)) break;
 	}
 
 	return EXIT_SUCCESS;
@@ -0,0 +1,308 @@
+#include "sshell_utils.h"
+
+#include <math.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_RUNS 10
+#define BENCH_DEFAULT_WARMUPS 1
+
+/*
+ * A pipeline compared by bench, and the measurements of its runs, in milliseconds
+ */
+struct BenchPipeline {
+	struct Parameter ** commands;
+	int numCommands;
+	char description[CMDLINE_MAX];
+	double * times;
+	double userTime;
+	double systemTime;
+	int failedRuns;
+};
+
+/*
+ * Summary statistics of the times of a pipeline
+ */
+struct BenchStats {
+	double mean;
+	double median;
+	double stddev;
+	double min;
+	double max;
+	int outliers;
+};
+
+/*
+ * Current time on the monotonic clock, in milliseconds
+ */
+static double nowMilliseconds() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+/*
+ * Length of a rusage time, in milliseconds
+ */
+static double timevalMilliseconds(struct timeval * time) {
+	return time->tv_sec * 1e3 + time->tv_usec / 1e3;
+}
+
+/*
+ * Orders times
+ */
+static int compareTimes(const void * a, const void * b) {
+	double first = *(const double *)a, second = *(const double *)b;
+	return (first > second) - (first < second);
+}
+
+/*
+ * Value at a fraction of sorted times, interpolated between the closest two
+ */
+static double quantile(double * sorted, int count, double fraction) {
+	double position = fraction * (count - 1);
+	int below = (int)position;
+	if (below >= count - 1) return sorted[count - 1];
+
+	return sorted[below] + (position - below) * (sorted[below + 1] - sorted[below]);
+}
+
+/*
+ * Computes the summary statistics of the times of count runs. Outliers are the runs beyond 1.5 interquartile ranges from the quartiles.
+ */
+static void computeStats(double * times, int count, struct BenchStats * stats) {
+	double * sorted = malloc(sizeof(double) * count);
+	memcpy(sorted, times, sizeof(double) * count);
+	qsort(sorted, count, sizeof(double), compareTimes);
+
+	double sum = 0, squares = 0;
+	for (int i = 0; i < count; i++) sum += sorted[i];
+	stats->mean = sum / count;
+	for (int i = 0; i < count; i++) squares += (sorted[i] - stats->mean) * (sorted[i] - stats->mean);
+
+	stats->stddev = count > 1 ? sqrt(squares / (count - 1)) : 0;
+	stats->median = quantile(sorted, count, 0.5);
+	stats->min = sorted[0];
+	stats->max = sorted[count - 1];
+
+	double lower = quantile(sorted, count, 0.25), upper = quantile(sorted, count, 0.75);
+	double fence = 1.5 * (upper - lower);
+	stats->outliers = 0;
+	for (int i = 0; i < count; i++) {
+		if (sorted[i] < lower - fence || sorted[i] > upper + fence) stats->outliers++;
+	}
+
+	free(sorted);
+}
+
+/*
+ * Adds a stage made of length arguments to a pipeline. Returns 1 and prints an error if the stage is empty.
+ */
+static int addStage(struct BenchPipeline * pipeline, char ** args, int length) {
+	if (length == 0) {
+		fprintf(stderr, "Error: missing command\n");
+		return 1;
+	}
+
+	char ** stageArgs = malloc(sizeof(char *) * (length + 1));
+	memcpy(stageArgs, args, sizeof(char *) * length);
+	stageArgs[length] = NULL;
+
+	struct Parameter * stage = malloc(sizeof(struct Parameter));
+	stage->parameterName = stageArgs[0];
+	stage->arguments = stageArgs;
+	stage->executablePath = NULL;
+	pipeline->commands[pipeline->numCommands++] = stage;
+
+	/* Describe the pipeline as it was written */
+	size_t used = strlen(pipeline->description);
+	for (int i = 0; i < length; i++) {
+		char * separator = used == 0 ? "" : (i == 0 ? " | " : " ");
+		used += snprintf(pipeline->description + used, used < CMDLINE_MAX ? CMDLINE_MAX - used : 0, "%s%s", separator, args[i]);
+	}
+
+	return 0;
+}
+
+/*
+ * Deallocates the stages of the pipelines, whose arguments belong to the command line
+ */
+static void freePipelines(struct BenchPipeline pipelines[], int numPipelines) {
+	for (int i = 0; i < numPipelines; i++) {
+		for (int j = 0; j < pipelines[i].numCommands; j++) {
+			free(pipelines[i].commands[j]->arguments);
+			free(pipelines[i].commands[j]);
+		}
+
+		free(pipelines[i].commands);
+		free(pipelines[i].times);
+	}
+}
+
+/*
+ * Splits the commands following bench's options into pipelines separated by -- arguments.
+ * Returns the number of pipelines, or 0 and prints an error if one of them has an empty command.
+ */
+static int splitPipelines(struct Parameter ** parameters, int parameterCount, char ** first, struct BenchPipeline pipelines[]) {
+	int numPipelines = 1;
+	memset(&pipelines[0], 0, sizeof(struct BenchPipeline));
+	pipelines[0].commands = malloc(sizeof(struct Parameter *) * parameterCount);
+
+	for (int i = 0; i < parameterCount; i++) {
+		char ** start = i == 0 ? first : parameters[i]->arguments;
+		char ** cur = start;
+
+		for (; *cur != NULL; cur++) {
+			if (strcmp(*cur, "--")) continue;
+
+			/* End the current pipeline, and start the next one */
+			if (addStage(&pipelines[numPipelines - 1], start, cur - start)) break;
+			memset(&pipelines[numPipelines], 0, sizeof(struct BenchPipeline));
+			pipelines[numPipelines++].commands = malloc(sizeof(struct Parameter *) * parameterCount);
+			start = cur + 1;
+		}
+
+		if (*cur != NULL || addStage(&pipelines[numPipelines - 1], start, cur - start)) {
+			freePipelines(pipelines, numPipelines);
+			return 0;
+		}
+	}
+
+	return numPipelines;
+}
+
+/*
+ * Runs every pipeline warmups times and then runs times, in rounds that run each pipeline once, so that changes in
+ * the machine's load affect all of them alike. Outputs go to /dev/null, and the look-ahead of batch mode is paused
+ * so that it is not timed along with the pipelines. Returns 1 if a pipeline could not be started.
+ */
+static int runRounds(struct BenchPipeline pipelines[], int numPipelines, int runs, int warmups) {
+	fflush(stdout);
+	int savedStdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+	int devNull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (savedStdout == -1 || devNull == -1) {
+		perror("open");
+		if (savedStdout != -1) close(savedStdout);
+		return 1;
+	}
+	dup2(devNull, STDOUT_FILENO);
+	close(devNull);
+	pausePipelineWaitHook(1);
+
+	int failed = 0;
+	for (int round = -warmups; round < runs && !failed; round++) {
+		for (int i = 0; i < numPipelines && !failed; i++) {
+			struct BenchPipeline * pipeline = &pipelines[i];
+			int waitStatuses[pipeline->numCommands];
+			struct rusage before, after;
+
+			getrusage(RUSAGE_CHILDREN, &before);
+			double start = nowMilliseconds();
+			failed = runPipeline(pipeline->commands, pipeline->numCommands, waitStatuses);
+			double elapsed = nowMilliseconds() - start;
+			getrusage(RUSAGE_CHILDREN, &after);
+
+			if (failed || round < 0) continue;
+
+			pipeline->times[round] = elapsed;
+			pipeline->userTime += timevalMilliseconds(&after.ru_utime) - timevalMilliseconds(&before.ru_utime);
+			pipeline->systemTime += timevalMilliseconds(&after.ru_stime) - timevalMilliseconds(&before.ru_stime);
+
+			for (int j = 0; j < pipeline->numCommands; j++) {
+				if (!WIFEXITED(waitStatuses[j]) || WEXITSTATUS(waitStatuses[j])) {
+					pipeline->failedRuns++;
+					break;
+				}
+			}
+		}
+	}
+
+	pausePipelineWaitHook(0);
+	dup2(savedStdout, STDOUT_FILENO);
+	close(savedStdout);
+	return failed;
+}
+
+/*
+ * Prints the statistics of every pipeline, and how they compare to the fastest one by median
+ */
+static void printReport(int fd, struct BenchPipeline pipelines[], int numPipelines, int runs, int warmups) {
+	struct BenchStats stats[numPipelines];
+	int fastest = 0;
+
+	for (int i = 0; i < numPipelines; i++) {
+		struct BenchPipeline * pipeline = &pipelines[i];
+		computeStats(pipeline->times, runs, &stats[i]);
+		if (stats[i].median < stats[fastest].median) fastest = i;
+
+		dprintf(fd, "'%s'\n", pipeline->description);
+		dprintf(fd, "  time: mean %.3f ms, median %.3f ms, stddev %.3f ms, min %.3f ms, max %.3f ms (%d runs, %d warmups)\n",
+			stats[i].mean, stats[i].median, stats[i].stddev, stats[i].min, stats[i].max, runs, warmups);
+		dprintf(fd, "  cpu: user %.3f ms, sys %.3f ms per run\n", pipeline->userTime / runs, pipeline->systemTime / runs);
+		dprintf(fd, "  outliers: %d of %d runs\n", stats[i].outliers, runs);
+		if (pipeline->failedRuns) dprintf(fd, "  failed: %d of %d runs exited with a non-zero status\n", pipeline->failedRuns, runs);
+	}
+
+	if (numPipelines < 2) return;
+
+	dprintf(fd, "fastest: '%s'\n", pipelines[fastest].description);
+	for (int i = 0; i < numPipelines; i++) {
+		if (i == fastest) continue;
+		double ratio = stats[fastest].median > 0 ? stats[i].median / stats[fastest].median : 0;
+		dprintf(fd, "  %.2fx slower: '%s'\n", ratio, pipelines[i].description);
+	}
+}
+
+/*
+ * Builtin bench command: bench [-n runs] [-w warmups] -- pipeline [-- pipeline...]
+ * Parses the pipelines once and runs them repeatedly with their output discarded, then prints the statistics of their times,
+ * to stdout or the output file. Prints a single completed message, and returns the number of exit statuses stored in statuses.
+ */
+int bench(struct Parameter ** parameters, int parameterCount, int outputMode, char * outputFile, char * cmd, int statuses[]) {
+	char ** args = parameters[0]->arguments + 1;
+	int runs = BENCH_DEFAULT_RUNS, warmups = BENCH_DEFAULT_WARMUPS;
+	statuses[0] = 1;
+
+	while (args[0] != NULL && args[0][0] == '-' && strcmp(args[0], "--")) {
+		char * end = NULL;
+		long value = args[1] != NULL ? strtol(args[1], &end, 10) : -1;
+		int invalid = end == NULL || end == args[1] || *end != '\0';
+
+		if (!strcmp(args[0], "-n") && !invalid && value > 0) runs = (int)value;
+		else if (!strcmp(args[0], "-w") && !invalid && value >= 0) warmups = (int)value;
+		else {
+			fprintf(stderr, "Error: invalid bench option\n");
+			fprintf(stderr, "+ completed '%s' [1]\n", cmd);
+			return 1;
+		}
+
+		args += 2;
+	}
+	if (args[0] != NULL && !strcmp(args[0], "--")) args++;
+
+	struct BenchPipeline pipelines[MAX_ARGUMENTS];
+	int numPipelines = splitPipelines(parameters, parameterCount, args, pipelines);
+
+	/* Open the output file before running anything, like a regular pipeline */
+	int reportfd = STDOUT_FILENO;
+	if (numPipelines > 0 && outputMode != WRITE_TO_STDOUT) {
+		reportfd = openOutputFile(outputMode, outputFile);
+		if (reportfd == -1) fprintf(stderr, "Error: cannot open output file\n");
+	}
+
+	if (numPipelines > 0 && reportfd != -1) {
+		for (int i = 0; i < numPipelines; i++) pipelines[i].times = malloc(sizeof(double) * runs);
+
+		if (!runRounds(pipelines, numPipelines, runs, warmups)) {
+			fflush(stdout);
+			printReport(reportfd, pipelines, numPipelines, runs, warmups);
+			statuses[0] = 0;
+		}
+	}
+
+	if (reportfd != STDOUT_FILENO && reportfd != -1) close(reportfd);
+	freePipelines(pipelines, numPipelines);
+
+	fprintf(stderr, "+ completed '%s' [%d]\n", cmd, statuses[0]);
+	return 1;
+}
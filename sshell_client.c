@@ -0,0 +1,98 @@
+#include "sshell_utils.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+ * Sends a command line to the server, along with this process's stdin, stdout and stderr, and waits for its reply.
+ * Returns 1 if the server cannot be reached.
+ */
+static int sendCommandLine(int connection, char * cmd, struct ServeReply * reply) {
+	int fds[SERVE_NUM_FDS] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+	char control[CMSG_SPACE(sizeof(fds))];
+	memset(control, 0, sizeof(control));
+
+	struct iovec line = { cmd, strlen(cmd) };
+	struct msghdr message = { 0 };
+	message.msg_iov = &line;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+
+	struct cmsghdr * header = CMSG_FIRSTHDR(&message);
+	header->cmsg_level = SOL_SOCKET;
+	header->cmsg_type = SCM_RIGHTS;
+	header->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+	if (sendmsg(connection, &message, MSG_NOSIGNAL) == -1) return 1;
+
+	ssize_t length;
+	do {
+		length = recv(connection, reply, sizeof(struct ServeReply), 0);
+	} while (length == -1 && errno == EINTR);
+
+	return length != sizeof(struct ServeReply);
+}
+
+/*
+ * Client of sshell's command server mode: sshellc socket [command line].
+ * Runs the command line given as arguments, or every line of stdin, and exits with the status of the last command.
+ */
+int main(int argc, char * argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s socket [command line]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, argv[1], sizeof(address.sun_path) - 1);
+
+	int connection = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (connection == -1 || connect(connection, (struct sockaddr *)&address, sizeof(address))) {
+		perror("connect");
+		return EXIT_FAILURE;
+	}
+
+	char cmd[CMDLINE_MAX];
+	struct ServeReply reply = { 0 };
+	int retval = 0;
+
+	//Join the arguments into a single command line
+	if (argc > 2) {
+		int length = 0;
+		cmd[0] = '\0';
+		for (int i = 2; i < argc; i++) {
+			length += snprintf(cmd + length, CMDLINE_MAX - length, i > 2 ? " %s" : "%s", argv[i]);
+			if (length >= CMDLINE_MAX) {
+				fprintf(stderr, "Error: command line too long\n");
+				return EXIT_FAILURE;
+			}
+		}
+
+		if (sendCommandLine(connection, cmd, &reply)) {
+			fprintf(stderr, "Error: lost connection to server\n");
+			return EXIT_FAILURE;
+		}
+		retval = reply.numStatuses > 0 ? reply.statuses[reply.numStatuses-1] : 1;
+	}
+
+	//Otherwise, run every line of stdin in the same session
+	else {
+		while (fgets(cmd, CMDLINE_MAX, stdin) != NULL) {
+			if (sendCommandLine(connection, cmd, &reply)) {
+				fprintf(stderr, "Error: lost connection to server\n");
+				return EXIT_FAILURE;
+			}
+			//Blank lines and parse errors leave the status of the previous command line
+			if (reply.numStatuses > 0) retval = reply.statuses[reply.numStatuses-1];
+			if (reply.exitRequested) break;
+		}
+	}
+
+	close(connection);
+	return retval;
+}
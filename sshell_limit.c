@@ -0,0 +1,309 @@
+#include "sshell_utils.h"
+
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <time.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+/*
+ * Time between the SIGTERM sent to a pipeline that timed out and the SIGKILL sent to its remaining commands
+ */
+#define LIMIT_KILL_DELAY_MS 2000
+
+/*
+ * Exit status reported for the command whose time limit expired, like timeout(1)
+ */
+#define LIMIT_TIMEOUT_STATUS 124
+
+/*
+ * Parses a duration such as 5s, 500ms, 2m or 1h, or a plain number of seconds, into milliseconds.
+ * Returns 1 if invalid, including for infinite durations and those too long to count in milliseconds.
+ */
+static int parseDuration(char * string, long long * milliseconds) {
+	char * unit;
+	double value = strtod(string, &unit);
+	if (unit == string || !isfinite(value) || value < 0) return 1;
+
+	if (*unit == '\0' || !strcmp(unit, "s")) value *= 1000;
+	else if (!strcmp(unit, "m")) value *= 60000;
+	else if (!strcmp(unit, "h")) value *= 3600000;
+	else if (strcmp(unit, "ms")) return 1;
+
+	/* Deadlines are added to the current time */
+	if (value >= (double)(LLONG_MAX / 2)) return 1;
+
+	*milliseconds = (long long)value;
+	return *milliseconds <= 0;
+}
+
+/*
+ * Parses a size such as 64K, 512M or 1G, or a plain number of bytes. Returns 1 if invalid.
+ */
+static int parseSize(char * string, rlim_t * bytes) {
+	char * unit;
+	unsigned long long value = strtoull(string, &unit, 10);
+	if (unit == string || string[0] == '-') return 1;
+
+	if (*unit == 'K' || *unit == 'k') value <<= 10;
+	else if (*unit == 'M' || *unit == 'm') value <<= 20;
+	else if (*unit == 'G' || *unit == 'g') value <<= 30;
+	else if (*unit != '\0') return 1;
+
+	if (*unit != '\0' && unit[1] != '\0') return 1;
+	*bytes = value;
+	return 0;
+}
+
+/*
+ * Parses a plain count. Returns 1 if invalid.
+ */
+static int parseCount(char * string, rlim_t * count) {
+	char * end;
+	unsigned long long value = strtoull(string, &end, 10);
+	if (end == string || *end != '\0' || string[0] == '-') return 1;
+
+	*count = value;
+	return 0;
+}
+
+/*
+ * Sets both the soft and hard value of a resource limit
+ */
+static int setLimit(int resource, rlim_t value) {
+	struct rlimit limit = { value, value };
+	return setrlimit(resource, &limit);
+}
+
+/*
+ * Finds the time limit of a pipeline stage, from the "limit --time duration" prefixes among its limit and pin prefixes,
+ * which may come in any order, in milliseconds. Returns 0 if the stage has no valid time limit;
+ * invalid prefixes are reported by applyStageLimits and applyStagePlacement in the stage's process.
+ */
+long long getStageTimeout(struct Parameter * parameter) {
+	char ** args = parameter->arguments;
+	long long stageTimeout = 0;
+
+	while (args[0] != NULL && (!strcmp(args[0], "limit") || !strcmp(args[0], "pin"))) {
+		int isLimit = !strcmp(args[0], "limit");
+
+		for (args++; args[0] != NULL && args[0][0] == '-' && args[1] != NULL; args += 2) {
+			long long timeout;
+			if (isLimit && !strcmp(args[0], "--time") && !parseDuration(args[1], &timeout) && (stageTimeout == 0 || timeout < stageTimeout)) {
+				stageTimeout = timeout;
+			}
+		}
+
+		/* CPU list of a pin prefix, recognized by its leading digit */
+		if (!isLimit && args[0] != NULL && args[0][0] >= '0' && args[0][0] <= '9') args++;
+	}
+
+	return stageTimeout;
+}
+
+/*
+ * Applies the resource limits of a "limit [--time duration] [--mem size] [--nofile count] [--cpu seconds] cmd..." prefix,
+ * in the stage's process before it runs, and removes the prefix from the stage. The time limit itself is enforced by the shell.
+ * Returns 1 and prints an error if the prefix is invalid or a limit cannot be set.
+ */
+int applyStageLimits(struct Parameter * parameter) {
+	if (strcmp(parameter->parameterName, "limit")) return 0;
+
+	char ** args = parameter->arguments + 1;
+	while (args[0] != NULL && args[0][0] == '-') {
+		long long timeout;
+		rlim_t value;
+		int invalid = args[1] == NULL;
+
+		if (invalid);
+		else if (!strcmp(args[0], "--time")) invalid = parseDuration(args[1], &timeout);
+		else if (!strcmp(args[0], "--mem")) invalid = parseSize(args[1], &value) || setLimit(RLIMIT_AS, value);
+		else if (!strcmp(args[0], "--nofile")) invalid = parseCount(args[1], &value) || setLimit(RLIMIT_NOFILE, value);
+		else if (!strcmp(args[0], "--cpu")) invalid = parseCount(args[1], &value) || setLimit(RLIMIT_CPU, value);
+		else invalid = 1;
+
+		if (invalid) {
+			fprintf(stderr, "Error: invalid limit '%s'\n", args[0]);
+			return 1;
+		}
+
+		args += 2;
+	}
+
+	if (args[0] == NULL) {
+		fprintf(stderr, "Error: missing command\n");
+		return 1;
+	}
+
+	/* The stage runs the command that follows the limit options */
+	parameter->arguments = args;
+	parameter->parameterName = args[0];
+	return 0;
+}
+
+/*
+ * Current time on the monotonic clock, in milliseconds, which time limits count from
+ */
+long long monotonicMilliseconds() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/*
+ * Arms a timer for an absolute time on the monotonic clock in milliseconds, or disarms it for -1
+ */
+static void armTimer(int timerfd, long long deadline) {
+	struct itimerspec timer = { { 0, 0 }, { 0, 0 } };
+	if (deadline != -1) {
+		timer.it_value.tv_sec = deadline / 1000;
+		timer.it_value.tv_nsec = (deadline % 1000) * 1000000 + 1;
+	}
+
+	timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &timer, NULL);
+}
+
+/*
+ * Sends a signal to every command of the pipeline that has not been reaped yet
+ */
+static void signalRunning(pid_t childPIDs[], int pidfds[], int numCommands, int signalNumber, int signaled[]) {
+	for (int i = 0; i < numCommands; i++) {
+		if (pidfds[i] != -1) {
+			kill(childPIDs[i], signalNumber);
+			signaled[i] = signalNumber;
+		}
+	}
+}
+
+/*
+ * Checks that pidfds and timerfds, which waitWithTimeouts needs, are available, before a time-limited pipeline starts
+ */
+int timeLimitsSupported() {
+	int timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	int pidfd = timerfd == -1 ? -1 : (int)syscall(SYS_pidfd_open, getpid(), 0);
+
+	if (timerfd != -1) close(timerfd);
+	if (pidfd != -1) close(pidfd);
+	return pidfd != -1;
+}
+
+/*
+ * Waits for every command of a pipeline, started at startTime on the monotonic clock, while enforcing the time limits
+ * of its stages, with one poll loop over a pidfd per command and a timerfd for the next deadline.
+ * When a stage's time runs out, every remaining command gets SIGTERM, then SIGKILL after LIMIT_KILL_DELAY_MS.
+ * The stage that timed out is reported with status LIMIT_TIMEOUT_STATUS, and the commands killed because of it with 128 plus the signal.
+ * If the descriptors cannot be created, such as when the shell runs out of them, the limits cannot be enforced,
+ * so the pipeline is killed right away, with an error.
+ */
+void waitWithTimeouts(pid_t childPIDs[], int numCommands, long long startTime, long long timeouts[], int statuses[]) {
+	int pidfds[numCommands], timedOut[numCommands], signaled[numCommands];
+	memset(timedOut, 0, sizeof(timedOut));
+	memset(signaled, 0, sizeof(signaled));
+
+	int timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	for (int i = 0; i < numCommands; i++) {
+		pidfds[i] = timerfd == -1 ? -1 : (int)syscall(SYS_pidfd_open, childPIDs[i], 0);
+		if (pidfds[i] == -1) {
+			fprintf(stderr, "Error: cannot enforce time limit\n");
+			for (int j = 0; j < i; j++) close(pidfds[j]);
+			if (timerfd != -1) close(timerfd);
+
+			for (int j = 0; j < numCommands; j++) {
+				kill(childPIDs[j], SIGKILL);
+				waitpid(childPIDs[j], &statuses[j], 0);
+				statuses[j] = W_EXITCODE(128 + SIGKILL, 0);
+			}
+			return;
+		}
+	}
+
+	int running = numCommands;
+	long long killTime = -1;
+	int killed = 0;
+
+	while (running > 0) {
+		/* Wake up at the next stage deadline, or at the SIGKILL deadline once the pipeline has been terminated.
+		 * Once it has been killed, only the commands finishing are left to wait for. */
+		long long deadline = killed ? -1 : killTime;
+		if (killTime == -1) {
+			for (int i = 0; i < numCommands; i++) {
+				if (pidfds[i] != -1 && timeouts[i] > 0 && (deadline == -1 || startTime + timeouts[i] < deadline)) {
+					deadline = startTime + timeouts[i];
+				}
+			}
+		}
+		armTimer(timerfd, deadline);
+
+		struct pollfd fds[numCommands + 1];
+		int commandOf[numCommands];
+		int numFds = 0;
+		for (int i = 0; i < numCommands; i++) {
+			if (pidfds[i] == -1) continue;
+			fds[numFds].fd = pidfds[i];
+			fds[numFds].events = POLLIN;
+			commandOf[numFds++] = i;
+		}
+		fds[numFds].fd = timerfd;
+		fds[numFds].events = POLLIN;
+
+		if (poll(fds, numFds + 1, -1) == -1) {
+			if (errno == EINTR) continue;
+			perror("poll");
+			break;
+		}
+
+		/* Reap the commands that finished */
+		for (int j = 0; j < numFds; j++) {
+			if (!fds[j].revents) continue;
+
+			int i = commandOf[j];
+			waitpid(childPIDs[i], &statuses[i], 0);
+			close(pidfds[i]);
+			pidfds[i] = -1;
+			running--;
+		}
+
+		if (!fds[numFds].revents) continue;
+
+		uint64_t expirations;
+		if (read(timerfd, &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+
+		/* First deadline: mark the stages that ran out of time, and terminate the whole pipeline */
+		if (killTime == -1) {
+			long long now = monotonicMilliseconds();
+			for (int i = 0; i < numCommands; i++) {
+				if (pidfds[i] != -1 && timeouts[i] > 0 && startTime + timeouts[i] <= now) timedOut[i] = 1;
+			}
+
+			signalRunning(childPIDs, pidfds, numCommands, SIGTERM, signaled);
+			killTime = now + LIMIT_KILL_DELAY_MS;
+		}
+
+		/* Commands that ignored SIGTERM */
+		else {
+			signalRunning(childPIDs, pidfds, numCommands, SIGKILL, signaled);
+			killed = 1;
+		}
+	}
+
+	/* Wait for anything left if polling failed */
+	for (int i = 0; i < numCommands; i++) {
+		if (pidfds[i] == -1) continue;
+		waitpid(childPIDs[i], &statuses[i], 0);
+		close(pidfds[i]);
+	}
+	close(timerfd);
+
+	for (int i = 0; i < numCommands; i++) {
+		if (timedOut[i]) statuses[i] = W_EXITCODE(LIMIT_TIMEOUT_STATUS, 0);
+		else if (signaled[i] && WIFSIGNALED(statuses[i])) statuses[i] = W_EXITCODE(128 + WTERMSIG(statuses[i]), 0);
+	}
+}
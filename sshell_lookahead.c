@@ -0,0 +1,309 @@
+#include "sshell_utils.h"
+
+#define LOOKAHEAD_DEFAULT_LINES 16
+
+/*
+ * Number of command names whose executables are remembered, since scripts run the same few commands over and over
+ */
+#define LOOKAHEAD_CACHE_SIZE 64
+
+/*
+ * Number of PATH entries whose directories are watched for executables installed while a script runs.
+ * Executables found in later entries are left for execvp.
+ */
+#define LOOKAHEAD_PATH_ENTRIES 64
+
+/*
+ * Size of every read from the input, the same as the stdio buffer that fgets uses,
+ * so that commands reading the shell's stdin themselves find the input where they did before
+ */
+#define LOOKAHEAD_READ_SIZE 4096
+
+/*
+ * Input read from stdin in batch mode, and the lines that were parsed ahead of time, in order
+ */
+struct LookAhead {
+	char buffer[LOOKAHEAD_READ_SIZE + CMDLINE_MAX];
+	int start;
+	int end;
+	int endOfInput;
+
+	struct ParsedLine ** queue;
+	int capacity;
+	int first;
+	int count;
+
+	struct ParsedLine * current;
+	long generation;
+
+	struct timespec pathTimes[LOOKAHEAD_PATH_ENTRIES];
+	long pathTimesGeneration;
+};
+
+/*
+ * Executable found for a command name, and the index of its PATH entry, or NULL if it was not found, during a generation
+ */
+struct ResolvedName {
+	char * name;
+	char * path;
+	int entry;
+	long generation;
+};
+
+static struct LookAhead lookAhead;
+static struct ResolvedName resolvedNames[LOOKAHEAD_CACHE_SIZE];
+
+/*
+ * Takes the next line of the input, like fgets: up to and including its newline, or CMDLINE_MAX - 1 characters of a longer line.
+ * Reads more input only when allowed, and returns 0 if no complete line is available.
+ */
+static int takeInputLine(char input[CMDLINE_MAX], int mayRead) {
+	while (1) {
+		int available = lookAhead.end - lookAhead.start;
+		int limit = available < CMDLINE_MAX - 1 ? available : CMDLINE_MAX - 1;
+		char * start = lookAhead.buffer + lookAhead.start;
+		char * nl = memchr(start, '\n', limit);
+
+		int length = 0;
+		if (nl != NULL) length = nl - start + 1;
+		else if (available >= CMDLINE_MAX - 1) length = CMDLINE_MAX - 1;
+		else if (lookAhead.endOfInput) length = available;
+
+		if (length > 0) {
+			memcpy(input, start, length);
+			input[length] = '\0';
+			lookAhead.start += length;
+			return 1;
+		}
+
+		if (lookAhead.endOfInput || !mayRead) return 0;
+
+		/* Keep the incomplete line, which is shorter than a command line, at the start of the buffer */
+		memmove(lookAhead.buffer, start, available);
+		lookAhead.start = 0;
+		lookAhead.end = available;
+
+		ssize_t numRead = read(STDIN_FILENO, lookAhead.buffer + available, LOOKAHEAD_READ_SIZE);
+		if (numRead == -1 && errno == EINTR) continue;
+		if (numRead <= 0) lookAhead.endOfInput = 1;
+		else lookAhead.end += numRead;
+	}
+}
+
+/*
+ * Gets the modification times of the directories of the first count PATH entries, or zero for those that cannot be read
+ */
+static void getPathTimes(int count, struct timespec times[]) {
+	char * path = getenv("PATH");
+	if (path == NULL) path = "/bin:/usr/bin";
+
+	char directory[PATH_MAX];
+	struct stat directoryStat;
+
+	for (int i = 0; i < count; i++) {
+		char * end = strchrnul(path, ':');
+		int length = end - path;
+
+		/* An empty entry is the working directory */
+		if (length == 0) strcpy(directory, ".");
+		else snprintf(directory, sizeof(directory), "%.*s", length, path);
+
+		if (stat(directory, &directoryStat)) memset(&times[i], 0, sizeof(struct timespec));
+		else times[i] = directoryStat.st_mtim;
+
+		if (*end == '\0') return;
+		path = end + 1;
+	}
+}
+
+/*
+ * Finds an executable in PATH the way execvp does, returning its allocated path and the index of its PATH entry,
+ * or NULL if it is not found
+ */
+static char * findExecutable(char * name, int * entry) {
+	char * path = getenv("PATH");
+	if (path == NULL) path = "/bin:/usr/bin";
+
+	char candidate[PATH_MAX];
+	struct stat candidateStat;
+
+	for (*entry = 0; 1; (*entry)++) {
+		char * end = strchrnul(path, ':');
+		int length = end - path;
+
+		/* An empty entry is the working directory */
+		if (length == 0) snprintf(candidate, sizeof(candidate), "%s", name);
+		else snprintf(candidate, sizeof(candidate), "%.*s/%s", length, path, name);
+
+		if (!access(candidate, X_OK) && !stat(candidate, &candidateStat) && S_ISREG(candidateStat.st_mode)) {
+			return strdup(candidate);
+		}
+
+		if (*end == '\0') return NULL;
+		path = end + 1;
+	}
+}
+
+/*
+ * Finds the executable of a command name, remembering it for the rest of the generation, and returns an allocated copy of its path
+ * and the index of its PATH entry, or NULL if it is not found
+ */
+static char * findCachedExecutable(char * name, int * pathEntry) {
+	/* FNV-1a hash of the name */
+	unsigned int hash = 2166136261u;
+	for (char * c = name; *c != '\0'; c++) hash = (hash ^ (unsigned char)*c) * 16777619u;
+
+	struct ResolvedName * entry = &resolvedNames[hash % LOOKAHEAD_CACHE_SIZE];
+	if (entry->name == NULL || entry->generation != lookAhead.generation || strcmp(entry->name, name)) {
+		free(entry->name);
+		free(entry->path);
+		entry->name = strdup(name);
+		entry->path = findExecutable(name, &entry->entry);
+		entry->generation = lookAhead.generation;
+	}
+
+	*pathEntry = entry->entry;
+	return entry->path != NULL ? strdup(entry->path) : NULL;
+}
+
+/*
+ * Finds the executable of every command of a parsed line, except names with a slash, which are not searched in PATH,
+ * or forgets the executables found earlier. Relative PATH entries depend on the working directory,
+ * so the executables found are only valid for the current generation. The modification times of the PATH directories
+ * are taken before the first executable of a generation is found, so that isShadowed can tell whether they changed since.
+ */
+static void resolveExecutables(struct ParsedLine * line, int find) {
+	line->resolvedGeneration = lookAhead.generation;
+	line->resolvedPathEntries = 0;
+	if (line->parameters == NULL || line->parseRetval != NO_ERRORS) return;
+
+	if (find && lookAhead.pathTimesGeneration != lookAhead.generation) {
+		getPathTimes(LOOKAHEAD_PATH_ENTRIES, lookAhead.pathTimes);
+		lookAhead.pathTimesGeneration = lookAhead.generation;
+	}
+
+	/* The last Parameter is the output file when the line ends with a file redirect */
+	int numCommands = line->parameterCount;
+	if (numCommands > 1 && line->redirects[numCommands - 2] != PIPE) numCommands--;
+
+	for (int i = 0; i < numCommands; i++) {
+		struct Parameter * command = line->parameters[i];
+		free(command->executablePath);
+		command->executablePath = NULL;
+		if (!find || strchr(command->parameterName, '/') != NULL) continue;
+
+		int entry;
+		command->executablePath = findCachedExecutable(command->parameterName, &entry);
+		if (command->executablePath == NULL) continue;
+
+		/* Only the entries before the executable's own can shadow it */
+		if (entry >= LOOKAHEAD_PATH_ENTRIES) {
+			free(command->executablePath);
+			command->executablePath = NULL;
+		}
+		else if (entry > line->resolvedPathEntries) line->resolvedPathEntries = entry;
+	}
+}
+
+/*
+ * Checks the executables of a parsed line that were found ahead of time, before it runs. The lines run before it may have
+ * installed an executable of the same name in an earlier PATH entry, which execvp would run instead, and installing one
+ * changes the modification time of its directory. Returns 1 if one of the directories before the executables' own changed.
+ * A file that only becomes executable is not noticed, as with the command hashing of other shells.
+ */
+static int isShadowed(struct ParsedLine * line) {
+	struct timespec times[LOOKAHEAD_PATH_ENTRIES];
+	getPathTimes(line->resolvedPathEntries, times);
+
+	for (int i = 0; i < line->resolvedPathEntries; i++) {
+		if (times[i].tv_sec != lookAhead.pathTimes[i].tv_sec || times[i].tv_nsec != lookAhead.pathTimes[i].tv_nsec) return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Reads and parses the next input line into a new ParsedLine. Returns NULL if no complete line is available.
+ */
+static struct ParsedLine * prepareLine(int mayRead) {
+	char input[CMDLINE_MAX];
+	if (!takeInputLine(input, mayRead)) return NULL;
+
+	struct ParsedLine * line = malloc(sizeof(struct ParsedLine));
+
+	/* Remove trailing newline from command line */
+	char cmd[CMDLINE_MAX];
+	strcpy(cmd, input);
+	char * nl = strchr(cmd, '\n');
+	if (nl) *nl = '\0';
+
+	parseCommandLine(cmd, line);
+	strcpy(line->input, input);
+	return line;
+}
+
+/*
+ * Parses ahead the lines that are already read, and finds their executables, while the shell waits for a pipeline,
+ * up to the look-ahead capacity. Input is never read here, since the running commands may be reading the shell's stdin themselves.
+ */
+static void speculate() {
+	while (lookAhead.count < lookAhead.capacity) {
+		struct ParsedLine * line = prepareLine(0);
+		if (line == NULL) return;
+		resolveExecutables(line, 1);
+
+		lookAhead.queue[(lookAhead.first + lookAhead.count) % lookAhead.capacity] = line;
+		lookAhead.count++;
+	}
+}
+
+/*
+ * Starts reading stdin in batch mode, parsing up to $SSHELL_LOOKAHEAD lines ahead, or LOOKAHEAD_DEFAULT_LINES, while pipelines run
+ */
+void startLookAhead() {
+	char * configured = getenv("SSHELL_LOOKAHEAD");
+	lookAhead.capacity = configured != NULL ? atoi(configured) : LOOKAHEAD_DEFAULT_LINES;
+	lookAhead.pathTimesGeneration = -1;
+
+	if (lookAhead.capacity > 0) {
+		lookAhead.queue = malloc(sizeof(struct ParsedLine *) * lookAhead.capacity);
+		setPipelineWaitHook(speculate);
+	}
+}
+
+/*
+ * Returns the next line in batch mode, parsed ahead of time when it was already read, or NULL at the end of the input.
+ * The line stays valid until the next call.
+ */
+struct ParsedLine * nextLookAheadLine() {
+	/* The working directory only changes with cd, which makes executables found in relative PATH entries stale */
+	struct ParsedLine * previous = lookAhead.current;
+	if (previous != NULL) {
+		if (previous->parameters != NULL && previous->parseRetval == NO_ERRORS && !strcmp(previous->parameters[0]->parameterName, "cd")) {
+			lookAhead.generation++;
+		}
+
+		freeParsedLine(previous);
+		free(previous);
+		lookAhead.current = NULL;
+	}
+
+	struct ParsedLine * line;
+	if (lookAhead.count > 0) {
+		line = lookAhead.queue[lookAhead.first];
+		lookAhead.first = (lookAhead.first + 1) % lookAhead.capacity;
+		lookAhead.count--;
+
+		/* An executable shadowed by one that an earlier line installed makes every executable found so far stale.
+		 * Stale executables are left for execvp to find again. */
+		if (line->resolvedGeneration == lookAhead.generation && isShadowed(line)) lookAhead.generation++;
+		if (line->resolvedGeneration != lookAhead.generation) resolveExecutables(line, 0);
+	}
+	else {
+		line = prepareLine(1);
+		if (line == NULL) return NULL;
+	}
+
+	lookAhead.current = line;
+	return line;
+}
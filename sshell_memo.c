@@ -0,0 +1,626 @@
+#include "sshell_utils.h"
+
+#include <stdint.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+#define MEMO_DEFAULT_MAX_MB 256
+#define MEMO_HASH_LENGTH 32
+
+/*
+ * Environment variables that commonly change the output of commands, hashed into keys along with those named in $SSHELL_MEMO_ENV.
+ * Other variables, some of which change with every session, are left out so that they do not fill the store with keys.
+ */
+static char * relevantVariables[] = { "PATH", "HOME", "USER", "LANG", "LC_ALL", "LC_COLLATE", "LC_CTYPE", "LC_MESSAGES",
+	"LC_NUMERIC", "LC_TIME", "TZ", NULL };
+
+/*
+ * 128-bit hash made of two independent 64-bit hashes, used to name both cache keys and cached outputs
+ */
+struct MemoHash {
+	uint64_t low;
+	uint64_t high;
+};
+
+/*
+ * Cached output file, as seen when evicting the least recently used outputs
+ */
+struct MemoObject {
+	char name[MEMO_HASH_LENGTH + 1];
+	long long size;
+	struct timespec lastUsed;
+};
+
+/*
+ * Collects the cached outputs of the store while scanning its objects directory
+ */
+struct MemoObjectList {
+	struct MemoObject * objects;
+	int count;
+	int capacity;
+	long long totalSize;
+};
+
+/*
+ * Counters kept in the store's stats file
+ */
+struct MemoStats {
+	long long hits;
+	long long misses;
+	long long evictions;
+};
+
+/*
+ * Starts a new hash
+ */
+static void initHash(struct MemoHash * hash) {
+	hash->low = 0xCBF29CE484222325ULL;
+	hash->high = 0x6A09E667F3BCC909ULL;
+}
+
+/*
+ * Adds bytes to a hash: FNV-1a for the low half, and a rotate-multiply hash for the high half
+ */
+static void updateHash(struct MemoHash * hash, const void * data, size_t len) {
+	const unsigned char * bytes = data;
+	uint64_t low = hash->low, high = hash->high;
+
+	for (size_t i = 0; i < len; i++) {
+		low = (low ^ bytes[i]) * 0x100000001B3ULL;
+		high = (((high << 5) | (high >> 59)) ^ bytes[i]) * 0x9E3779B97F4A7C15ULL;
+	}
+
+	hash->low = low;
+	hash->high = high;
+}
+
+/*
+ * Adds a string to a hash, including its terminator so that consecutive strings cannot run into each other
+ */
+static void updateHashString(struct MemoHash * hash, const char * string) {
+	updateHash(hash, string, strlen(string) + 1);
+}
+
+/*
+ * Writes a hash as MEMO_HASH_LENGTH hexadecimal characters
+ */
+static void hashToString(struct MemoHash * hash, char string[MEMO_HASH_LENGTH + 1]) {
+	snprintf(string, MEMO_HASH_LENGTH + 1, "%016llx%016llx", (unsigned long long)hash->high, (unsigned long long)hash->low);
+}
+
+/*
+ * Creates a directory and its missing parents
+ */
+static int makeDirectories(char * path) {
+	char partial[PATH_MAX];
+	snprintf(partial, sizeof(partial), "%s", path);
+
+	for (char * slash = strchr(partial + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+		*slash = '\0';
+		if (mkdir(partial, 0755) && errno != EEXIST) return 1;
+		*slash = '/';
+	}
+
+	return mkdir(partial, 0755) && errno != EEXIST;
+}
+
+/*
+ * Finds the store directory: $SSHELL_MEMO_DIR, or sshell/memo inside $XDG_CACHE_HOME or ~/.cache.
+ * Creates the store's keys and objects directories if needed.
+ */
+static int getStoreDirectory(char store[PATH_MAX]) {
+	char * configured = getenv("SSHELL_MEMO_DIR");
+	char * cacheHome = getenv("XDG_CACHE_HOME");
+	char * home = getenv("HOME");
+
+	if (configured != NULL && configured[0] != '\0') snprintf(store, PATH_MAX, "%s", configured);
+	else if (cacheHome != NULL && cacheHome[0] != '\0') snprintf(store, PATH_MAX, "%s/sshell/memo", cacheHome);
+	else if (home != NULL && home[0] != '\0') snprintf(store, PATH_MAX, "%s/.cache/sshell/memo", home);
+	else return 1;
+
+	char subdirectory[PATH_MAX];
+	snprintf(subdirectory, sizeof(subdirectory), "%s/keys", store);
+	if (makeDirectories(subdirectory)) return 1;
+
+	snprintf(subdirectory, sizeof(subdirectory), "%s/objects", store);
+	return makeDirectories(subdirectory);
+}
+
+/*
+ * Maximum total size of the cached outputs, from $SSHELL_MEMO_MAX_MB
+ */
+static long long getStoreLimit() {
+	char * configured = getenv("SSHELL_MEMO_MAX_MB");
+	long long megabytes = configured != NULL ? atoll(configured) : 0;
+
+	return (megabytes > 0 ? megabytes : MEMO_DEFAULT_MAX_MB) * 1048576LL;
+}
+
+/*
+ * Writes a small file atomically, by writing a temporary file in the store and renaming it
+ */
+static int writeFileAtomically(char * store, char * path, char * contents) {
+	char tempPath[PATH_MAX];
+	snprintf(tempPath, sizeof(tempPath), "%s/tmp.XXXXXX", store);
+
+	int fd = mkostemp(tempPath, O_CLOEXEC);
+	if (fd == -1) return 1;
+
+	size_t length = strlen(contents);
+	int failed = write(fd, contents, length) != (ssize_t)length;
+	close(fd);
+
+	if (failed || rename(tempPath, path)) {
+		unlink(tempPath);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Reads the counters of an open stats file, which are all zero for a new store
+ */
+static void readStatsFile(int fd, struct MemoStats * stats) {
+	char contents[128];
+	ssize_t length = pread(fd, contents, sizeof(contents) - 1, 0);
+	contents[length > 0 ? length : 0] = '\0';
+
+	if (sscanf(contents, "%lld %lld %lld", &stats->hits, &stats->misses, &stats->evictions) != 3) {
+		memset(stats, 0, sizeof(struct MemoStats));
+	}
+}
+
+/*
+ * Reads the store's counters
+ */
+static void readStats(char * store, struct MemoStats * stats) {
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/stats", store);
+
+	memset(stats, 0, sizeof(struct MemoStats));
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) return;
+
+	if (!flock(fd, LOCK_SH)) readStatsFile(fd, stats);
+	close(fd);
+}
+
+/*
+ * Adds to the store's counters, holding a lock on the stats file so that shells sharing the store do not lose each other's updates
+ */
+static void addStats(char * store, long long hits, long long misses, long long evictions) {
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/stats", store);
+
+	int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd == -1) return;
+	if (flock(fd, LOCK_EX)) {
+		close(fd);
+		return;
+	}
+
+	struct MemoStats stats;
+	readStatsFile(fd, &stats);
+
+	char contents[128];
+	int length = snprintf(contents, sizeof(contents), "%lld %lld %lld\n", stats.hits + hits, stats.misses + misses, stats.evictions + evictions);
+	if (pwrite(fd, contents, length, 0) == length && ftruncate(fd, length)) perror("ftruncate");
+
+	/* Closing the file releases the lock */
+	close(fd);
+}
+
+/*
+ * Adds an environment variable to a hash, telling an unset variable from an empty one
+ */
+static void updateHashVariable(struct MemoHash * key, char * name) {
+	char * value = getenv(name);
+	updateHashString(key, name);
+	updateHashString(key, value != NULL ? "=" : "unset");
+	if (value != NULL) updateHashString(key, value);
+}
+
+/*
+ * Hashes everything the pipeline's output may depend on: its commands and arguments, the working directory,
+ * the relevant environment variables, and the identity, size and modification time of every declared dependency
+ */
+static void hashInputs(struct Parameter ** commands, int numCommands, char ** deps, int numDeps, struct MemoHash * key) {
+	initHash(key);
+
+	for (int i = 0; i < numCommands; i++) {
+		for (int j = 0; commands[i]->arguments[j] != NULL; j++) {
+			updateHashString(key, commands[i]->arguments[j]);
+		}
+		updateHashString(key, "|");
+	}
+
+	char cwd[PATH_MAX];
+	if (getcwd(cwd, sizeof(cwd)) != NULL) updateHashString(key, cwd);
+
+	for (int i = 0; relevantVariables[i] != NULL; i++) {
+		updateHashVariable(key, relevantVariables[i]);
+	}
+
+	/* Variables that the memoized commands depend on, separated by colons */
+	char * configured = getenv("SSHELL_MEMO_ENV");
+	if (configured != NULL) {
+		char names[CMDLINE_MAX];
+		snprintf(names, sizeof(names), "%s", configured);
+		for (char * name = strtok(names, ":"); name != NULL; name = strtok(NULL, ":")) updateHashVariable(key, name);
+	}
+
+	/* Missing dependencies are hashed too, so that creating them invalidates the entry */
+	for (int i = 0; i < numDeps; i++) {
+		struct stat depStat;
+		updateHashString(key, deps[i]);
+
+		if (stat(deps[i], &depStat)) {
+			updateHashString(key, "missing");
+			continue;
+		}
+
+		long long fields[] = { (long long)depStat.st_dev, (long long)depStat.st_ino, (long long)depStat.st_size,
+			(long long)depStat.st_mtim.tv_sec, (long long)depStat.st_mtim.tv_nsec };
+		updateHash(key, fields, sizeof(fields));
+	}
+}
+
+/*
+ * Looks up a key. On a hit, opens the cached output and reads the cached statuses, returning the output's descriptor.
+ * Returns -1 on a miss.
+ */
+static int lookupKey(char * store, char * keyName, int numCommands, int statuses[]) {
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/keys/%s", store, keyName);
+
+	FILE * keyFile = fopen(path, "r");
+	if (keyFile == NULL) return -1;
+
+	/* Key files hold the cached output's name, the number of commands, and the status of each command */
+	char objectName[MEMO_HASH_LENGTH + 1];
+	int numStatuses, valid = fscanf(keyFile, "%32s %d", objectName, &numStatuses) == 2 && numStatuses == numCommands;
+	for (int i = 0; valid && i < numCommands; i++) {
+		valid = fscanf(keyFile, "%d", &statuses[i]) == 1;
+	}
+	fclose(keyFile);
+
+	int fd = -1;
+	if (valid) {
+		char objectPath[PATH_MAX];
+		snprintf(objectPath, sizeof(objectPath), "%s/objects/%s", store, objectName);
+		fd = open(objectPath, O_RDONLY | O_CLOEXEC);
+	}
+
+	/* Drop malformed keys, and keys whose output was evicted */
+	if (fd == -1) unlink(path);
+	return fd;
+}
+
+/*
+ * Adds a cached output to the list built while scanning the objects directory
+ */
+static void collectObject(int dirfd, char * name, struct stat * entryStat, void * context) {
+	(void)dirfd;
+	struct MemoObjectList * list = context;
+
+	if (!S_ISREG(entryStat->st_mode) || strlen(name) != MEMO_HASH_LENGTH) return;
+
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity ? list->capacity * 2 : 64;
+		list->objects = realloc(list->objects, list->capacity * sizeof(struct MemoObject));
+	}
+
+	struct MemoObject * object = &list->objects[list->count++];
+	memcpy(object->name, name, MEMO_HASH_LENGTH + 1);
+	object->size = entryStat->st_size;
+	object->lastUsed = entryStat->st_mtim;
+	list->totalSize += entryStat->st_size;
+}
+
+/*
+ * Orders cached outputs from the least to the most recently used
+ */
+static int compareLastUsed(const void * a, const void * b) {
+	const struct MemoObject * first = a;
+	const struct MemoObject * second = b;
+
+	if (first->lastUsed.tv_sec != second->lastUsed.tv_sec) return first->lastUsed.tv_sec < second->lastUsed.tv_sec ? -1 : 1;
+	if (first->lastUsed.tv_nsec != second->lastUsed.tv_nsec) return first->lastUsed.tv_nsec < second->lastUsed.tv_nsec ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Scans the store's cached outputs. Returns 1 if the objects directory cannot be read.
+ */
+static int listObjects(char * store, struct MemoObjectList * list) {
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/objects", store);
+
+	memset(list, 0, sizeof(struct MemoObjectList));
+	int dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd == -1) return 1;
+
+	int retval = readDirectory(dirfd, AT_SYMLINK_NOFOLLOW, collectObject, list);
+	close(dirfd);
+	return retval;
+}
+
+/*
+ * Deletes a key whose cached output no longer exists, or that is malformed, while scanning the keys directory
+ */
+static void dropDanglingKey(int dirfd, char * name, struct stat * entryStat, void * context) {
+	int objectsfd = *(int *)context;
+	if (!S_ISREG(entryStat->st_mode)) return;
+
+	int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) return;
+
+	/* Key files start with the cached output's name */
+	char objectName[MEMO_HASH_LENGTH + 1];
+	ssize_t length = read(fd, objectName, MEMO_HASH_LENGTH);
+	close(fd);
+	objectName[length > 0 ? length : 0] = '\0';
+
+	if (length != MEMO_HASH_LENGTH || faccessat(objectsfd, objectName, F_OK, 0)) unlinkat(dirfd, name, 0);
+}
+
+/*
+ * Deletes the keys of outputs that were evicted
+ */
+static void dropDanglingKeys(char * store) {
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/objects", store);
+	int objectsfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	snprintf(path, sizeof(path), "%s/keys", store);
+	int keysfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	if (objectsfd != -1 && keysfd != -1) readDirectory(keysfd, AT_SYMLINK_NOFOLLOW, dropDanglingKey, &objectsfd);
+	if (objectsfd != -1) close(objectsfd);
+	if (keysfd != -1) close(keysfd);
+}
+
+/*
+ * Deletes the least recently used outputs until the store fits in its size limit, always keeping the newest output.
+ * Keys of deleted outputs are deleted along with them. Returns the number of deleted outputs.
+ */
+static int evictObjects(char * store, char * keepName) {
+	struct MemoObjectList list;
+	if (listObjects(store, &list)) return 0;
+
+	long long limit = getStoreLimit();
+	int evicted = 0;
+	qsort(list.objects, list.count, sizeof(struct MemoObject), compareLastUsed);
+
+	for (int i = 0; i < list.count && list.totalSize > limit; i++) {
+		if (!strcmp(list.objects[i].name, keepName)) continue;
+
+		char path[PATH_MAX];
+		snprintf(path, sizeof(path), "%s/objects/%s", store, list.objects[i].name);
+		if (!unlink(path)) {
+			list.totalSize -= list.objects[i].size;
+			evicted++;
+		}
+	}
+
+	free(list.objects);
+	if (evicted > 0) dropDanglingKeys(store);
+	return evicted;
+}
+
+/*
+ * Checks whether a cached output holds exactly the given contents
+ */
+static int isSameObject(char * objectPath, void * contents, off_t size) {
+	int fd = open(objectPath, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) return 0;
+
+	struct stat objectStat;
+	int same = !fstat(fd, &objectStat) && objectStat.st_size == size;
+	if (same && size > 0) {
+		void * mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		same = mapping != MAP_FAILED && !memcmp(mapping, contents, size);
+		if (mapping != MAP_FAILED) munmap(mapping, size);
+	}
+
+	close(fd);
+	return same;
+}
+
+/*
+ * Runs the pipeline with its output captured in the store, and records it under the key.
+ * Returns the captured output's descriptor, or -1 if the pipeline could not run.
+ */
+static int runAndStore(char * store, char * keyName, struct Parameter ** commands, int numCommands, int statuses[]) {
+	char tempPath[PATH_MAX];
+	snprintf(tempPath, sizeof(tempPath), "%s/tmp.XXXXXX", store);
+
+	int fd = mkostemp(tempPath, O_CLOEXEC);
+	if (fd == -1) return -1;
+
+	/* Run the pipeline with the shell's stdout temporarily pointing at the capture file */
+	fflush(stdout);
+	int savedStdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+	if (savedStdout == -1) {
+		close(fd);
+		unlink(tempPath);
+		return -1;
+	}
+	dup2(fd, STDOUT_FILENO);
+	int failed = runPipeline(commands, numCommands, statuses);
+	dup2(savedStdout, STDOUT_FILENO);
+	close(savedStdout);
+
+	if (failed) {
+		close(fd);
+		unlink(tempPath);
+		return -1;
+	}
+
+	/* Name the output by its contents, so that identical outputs are stored once */
+	struct MemoHash content;
+	struct stat outputStat;
+	void * mapping = NULL;
+	int storable = !fstat(fd, &outputStat);
+	initHash(&content);
+	if (storable && outputStat.st_size > 0) {
+		mapping = mmap(NULL, outputStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping != MAP_FAILED) updateHash(&content, mapping, outputStat.st_size);
+		else {
+			mapping = NULL;
+			storable = 0;
+		}
+	}
+
+	char objectName[MEMO_HASH_LENGTH + 1], objectPath[PATH_MAX], keyPath[PATH_MAX];
+	hashToString(&content, objectName);
+	snprintf(objectPath, sizeof(objectPath), "%s/objects/%s", store, objectName);
+	snprintf(keyPath, sizeof(keyPath), "%s/keys/%s", store, keyName);
+
+	/* The name is not a cryptographic digest, so an existing output with the same name is never replaced,
+	 * and is only reused when it holds the same bytes. Outputs that collide with it are not cached. */
+	int stored = storable && !link(tempPath, objectPath);
+	if (storable && !stored && errno == EEXIST && isSameObject(objectPath, mapping, outputStat.st_size)) {
+		/* Mark the existing output as recently used, for eviction */
+		utimensat(AT_FDCWD, objectPath, NULL, 0);
+		stored = 1;
+	}
+	unlink(tempPath);
+	if (mapping != NULL) munmap(mapping, outputStat.st_size);
+
+	/* Record the key only once its output is in place */
+	if (stored) {
+		char keyContents[MEMO_HASH_LENGTH + 16 + 12 * numCommands];
+		int length = snprintf(keyContents, sizeof(keyContents), "%s %d", objectName, numCommands);
+		for (int i = 0; i < numCommands; i++) {
+			length += snprintf(keyContents + length, sizeof(keyContents) - length, " %d", statuses[i]);
+		}
+		snprintf(keyContents + length, sizeof(keyContents) - length, "\n");
+		writeFileAtomically(store, keyPath, keyContents);
+	}
+
+	int evicted = evictObjects(store, objectName);
+	addStats(store, 0, 1, evicted);
+
+	lseek(fd, 0, SEEK_SET);
+	return fd;
+}
+
+/*
+ * Prints the counters and the size of the store, for memo --stats, to stdout or the output file
+ */
+static int printStats(int fd, char * store) {
+	struct MemoStats stats;
+	struct MemoObjectList list;
+	readStats(store, &stats);
+	if (listObjects(store, &list)) {
+		fprintf(stderr, "Error: cannot open directory\n");
+		return 1;
+	}
+	free(list.objects);
+
+	long long lookups = stats.hits + stats.misses;
+	dprintf(fd, "store: %s\n", store);
+	dprintf(fd, "hits: %lld\n", stats.hits);
+	dprintf(fd, "misses: %lld\n", stats.misses);
+	dprintf(fd, "hit rate: %.1f%%\n", lookups ? 100.0 * stats.hits / lookups : 0.0);
+	dprintf(fd, "evictions: %lld\n", stats.evictions);
+	dprintf(fd, "outputs: %d (%lld bytes, limit %lld bytes)\n", list.count, list.totalSize, getStoreLimit());
+
+	return 0;
+}
+
+/*
+ * Builtin memo command: memo [--deps file... --] pipeline, or memo --stats.
+ * Replays the cached output and statuses of the pipeline when its inputs are unchanged, and runs and caches it otherwise.
+ * Prints the completed message of the pipeline itself, and returns the number of exit statuses stored in statuses.
+ */
+int memo(struct Parameter ** parameters, int parameterCount, int outputMode, char * outputFile, char * cmd, int statuses[]) {
+	char ** args = parameters[0]->arguments + 1;
+	char store[PATH_MAX];
+
+	if (getStoreDirectory(store)) {
+		fprintf(stderr, "Error: cannot open memo store\n");
+		fprintf(stderr, "+ completed '%s' [1]\n", cmd);
+		statuses[0] = 1;
+		return 1;
+	}
+
+	if (args[0] != NULL && !strcmp(args[0], "--stats")) {
+		fflush(stdout);
+		int statsfd = outputMode == WRITE_TO_STDOUT ? STDOUT_FILENO : openOutputFile(outputMode, outputFile);
+		if (statsfd == -1) {
+			fprintf(stderr, "Error: cannot open output file\n");
+			return 0;
+		}
+
+		statuses[0] = printStats(statsfd, store);
+		if (statsfd != STDOUT_FILENO) close(statsfd);
+		fprintf(stderr, "+ completed '%s' [%d]\n", cmd, statuses[0]);
+		return 1;
+	}
+
+	/* Dependencies run from --deps to the next -- */
+	char ** deps = NULL;
+	int numDeps = 0;
+	if (args[0] != NULL && !strcmp(args[0], "--deps")) {
+		deps = ++args;
+		while (args[0] != NULL && strcmp(args[0], "--")) args++;
+		numDeps = args - deps;
+		if (args[0] != NULL) args++;
+	}
+
+	if (args[0] == NULL) {
+		fprintf(stderr, "Error: missing command\n");
+		fprintf(stderr, "+ completed '%s' [1]\n", cmd);
+		statuses[0] = 1;
+		return 1;
+	}
+
+	/* The memoized pipeline is the given one, with memo and its options removed from the first command */
+	struct Parameter first = { args[0], args, NULL };
+	struct Parameter * commands[parameterCount];
+	commands[0] = &first;
+	for (int i = 1; i < parameterCount; i++) commands[i] = parameters[i];
+
+	/* Open the output file before running anything, like a regular pipeline */
+	fflush(stdout);
+	int outputfd = outputMode == WRITE_TO_STDOUT ? STDOUT_FILENO : openOutputFile(outputMode, outputFile);
+	if (outputfd == -1) {
+		fprintf(stderr, "Error: cannot open output file\n");
+		return 0;
+	}
+
+	struct MemoHash key;
+	char keyName[MEMO_HASH_LENGTH + 1];
+	hashInputs(commands, parameterCount, deps, numDeps, &key);
+	hashToString(&key, keyName);
+
+	int waitStatuses[parameterCount];
+	int fd = lookupKey(store, keyName, parameterCount, waitStatuses);
+	if (fd != -1) {
+		/* Mark the output as recently used, for eviction */
+		futimens(fd, NULL);
+		addStats(store, 1, 0, 0);
+	}
+	else fd = runAndStore(store, keyName, commands, parameterCount, waitStatuses);
+
+	if (fd == -1) {
+		if (outputfd != STDOUT_FILENO) close(outputfd);
+		return 0;
+	}
+
+	int copied = copyFileData(fd, outputfd);
+	if (copied == COPY_READ_FAILED) fprintf(stderr, "Error: cannot read cached output\n");
+	else if (copied == COPY_WRITE_FAILED) fprintf(stderr, "Error: cannot write output\n");
+	close(fd);
+	if (outputfd != STDOUT_FILENO) close(outputfd);
+
+	printCompleted(cmd, waitStatuses, parameterCount);
+	for (int i = 0; i < parameterCount; i++) {
+		statuses[i] = WEXITSTATUS(waitStatuses[i]);
+	}
+
+	return parameterCount;
+}
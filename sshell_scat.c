@@ -0,0 +1,145 @@
+#include "sshell_utils.h"
+
+#include <sys/sendfile.h>
+
+/*
+ * Largest number of bytes moved by a single zero-copy call
+ */
+#define SCAT_CHUNK_SIZE (1 << 30)
+
+/*
+ * Size of the buffer of the read and write fallback
+ */
+#define SCAT_BUFFER_SIZE (1 << 20)
+
+/*
+ * Ways of copying data, from the cheapest: within the file system, through a pipe's buffers in the kernel,
+ * from the page cache to the output in the kernel, and through a buffer in user space
+ */
+enum CopyMethods {
+	COPY_FILE_RANGE,
+	COPY_SPLICE,
+	COPY_SENDFILE,
+	COPY_READ_WRITE
+};
+
+/*
+ * Checks whether an input and an output are the same regular file
+ */
+static int isSameFile(struct stat * inStat, struct stat * outStat) {
+	return S_ISREG(inStat->st_mode) && inStat->st_dev == outStat->st_dev && inStat->st_ino == outStat->st_ino;
+}
+
+/*
+ * Chooses the cheapest copy method at or after the given one that the types of the input and the output allow
+ */
+static int chooseCopyMethod(int method, struct stat * inStat, struct stat * outStat) {
+	/* Files without a size, like those of /proc, report nothing to copy to the zero-copy calls */
+	if (S_ISREG(inStat->st_mode) && inStat->st_size == 0) return COPY_READ_WRITE;
+
+	if (method <= COPY_FILE_RANGE && S_ISREG(inStat->st_mode) && S_ISREG(outStat->st_mode)) return COPY_FILE_RANGE;
+	if (method <= COPY_SPLICE && (S_ISFIFO(inStat->st_mode) || S_ISFIFO(outStat->st_mode))) return COPY_SPLICE;
+	if (method <= COPY_SENDFILE && S_ISREG(inStat->st_mode)) return COPY_SENDFILE;
+	return COPY_READ_WRITE;
+}
+
+/*
+ * Copies the rest of the input to the output, from and to their current positions, with the cheapest method that works:
+ * copy_file_range between regular files, splice when either side is a pipe, sendfile from a regular file
+ * (such as to a socket), and read and write otherwise, including to outputs opened for appending.
+ * A method that fails, such as one the descriptors do not support, falls back to the next one, which continues from where
+ * it stopped, so that read and write tell which side failed. Returns COPY_READ_FAILED or COPY_WRITE_FAILED if the data
+ * cannot be copied, and COPY_DONE otherwise.
+ */
+int copyFileData(int infd, int outfd) {
+	struct stat inStat, outStat;
+	if (fstat(infd, &inStat)) return COPY_READ_FAILED;
+	if (fstat(outfd, &outStat)) return COPY_WRITE_FAILED;
+
+	/* Copying a file onto itself would never reach the end of an appended file */
+	if (isSameFile(&inStat, &outStat)) return COPY_WRITE_FAILED;
+
+	/* The kernel copies refuse outputs opened for appending, and only write makes every chunk land at the end of the file
+	 * when other processes append to it too */
+	int outFlags = fcntl(outfd, F_GETFL);
+	int method = outFlags != -1 && (outFlags & O_APPEND) ? COPY_READ_WRITE : chooseCopyMethod(COPY_FILE_RANGE, &inStat, &outStat);
+
+	char * buffer = NULL;
+	ssize_t bufferStart = 0, bufferEnd = 0;
+	int failed = COPY_DONE;
+
+	while (1) {
+		ssize_t copied;
+
+		if (method == COPY_FILE_RANGE) copied = copy_file_range(infd, NULL, outfd, NULL, SCAT_CHUNK_SIZE, 0);
+		else if (method == COPY_SPLICE) copied = splice(infd, NULL, outfd, NULL, SCAT_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+		else if (method == COPY_SENDFILE) copied = sendfile(outfd, infd, NULL, SCAT_CHUNK_SIZE);
+		else {
+			/* Write out what was read before reading more */
+			if (buffer == NULL) buffer = malloc(SCAT_BUFFER_SIZE);
+			if (bufferStart == bufferEnd) {
+				bufferStart = 0;
+				bufferEnd = read(infd, buffer, SCAT_BUFFER_SIZE);
+				if (bufferEnd <= 0) {
+					copied = bufferEnd;
+					bufferEnd = 0;
+					if (copied == -1 && errno == EINTR) continue;
+					if (copied == -1) failed = COPY_READ_FAILED;
+					break;
+				}
+			}
+
+			copied = write(outfd, buffer + bufferStart, bufferEnd - bufferStart);
+			if (copied > 0) bufferStart += copied;
+			else if (copied == 0) copied = -1;
+		}
+
+		if (copied > 0) continue;
+		if (copied == 0) break;
+		if (errno == EINTR) continue;
+
+		if (method != COPY_READ_WRITE) {
+			method = chooseCopyMethod(method + 1, &inStat, &outStat);
+			continue;
+		}
+
+		failed = COPY_WRITE_FAILED;
+		break;
+	}
+
+	free(buffer);
+	return failed;
+}
+
+/*
+ * Builtin scat command: writes each file, or stdin by default, to stdout, without copying the data through the process when possible
+ */
+int scat(struct Parameter * parameter) {
+	char ** args = parameter->arguments + 1;
+	int retval = 0, copied;
+
+	struct stat inStat, outStat;
+	if (fstat(STDOUT_FILENO, &outStat)) outStat.st_mode = 0;
+
+	do {
+		int fd = args[0] == NULL || !strcmp(args[0], "-") ? STDIN_FILENO : open(args[0], O_RDONLY | O_CLOEXEC);
+
+		if (fd == -1) {
+			fprintf(stderr, "Error: cannot read file '%s'\n", args[0] != NULL ? args[0] : "-");
+			retval = 1;
+		}
+		else if (!fstat(fd, &inStat) && isSameFile(&inStat, &outStat)) {
+			fprintf(stderr, "Error: input file is output file\n");
+			retval = 1;
+		}
+		else if ((copied = copyFileData(fd, STDOUT_FILENO)) != COPY_DONE) {
+			if (copied == COPY_READ_FAILED) fprintf(stderr, "Error: cannot read file '%s'\n", args[0] != NULL ? args[0] : "-");
+			else fprintf(stderr, "Error: cannot write output\n");
+			retval = 1;
+		}
+
+		if (fd > STDIN_FILENO) close(fd);
+	} while (args[0] != NULL && (++args)[0] != NULL);
+
+	return retval;
+}
@@ -0,0 +1,278 @@
+#include "sshell_utils.h"
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#define MAX_CACHE_INDEXES 10
+
+/* ioprio_set encoding, which glibc does not provide */
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+
+/*
+ * Cache topology read from /sys: for every CPU, the lowest-numbered CPU sharing its L2 and its L3 cache, or -1 if unknown
+ */
+struct CacheTopology {
+	int loaded;
+	int numCPUs;
+	int l2Leader[CPU_SETSIZE];
+	int l3Leader[CPU_SETSIZE];
+};
+
+/*
+ * Whether stages of pipelines without explicit pin options are placed automatically, set with the autopin builtin
+ */
+static int autoPlacement = 0;
+
+/*
+ * Number of pipelines placed so far, used to spread pipelines over the L3 cache domains
+ */
+static int placedPipelines = 0;
+
+static struct CacheTopology topology;
+
+/*
+ * Parses a CPU list such as "0-3,8,10-11" into a CPU set. Returns 1 if the list is invalid or empty.
+ */
+int parseCPUList(char * list, cpu_set_t * cpus) {
+	CPU_ZERO(cpus);
+	char * cur = list;
+
+	while (*cur != '\0' && *cur != '\n') {
+		char * end;
+		long first = strtol(cur, &end, 10), last = first;
+		if (end == cur || first < 0) return 1;
+
+		if (*end == '-') {
+			cur = end + 1;
+			last = strtol(cur, &end, 10);
+			if (end == cur || last < first) return 1;
+		}
+
+		if (last >= CPU_SETSIZE) return 1;
+		for (long cpu = first; cpu <= last; cpu++) CPU_SET(cpu, cpus);
+
+		cur = end;
+		if (*cur == ',') cur++;
+		else if (*cur != '\0' && *cur != '\n') return 1;
+	}
+
+	return CPU_COUNT(cpus) == 0;
+}
+
+/*
+ * Reads the first line of a small sysfs file. Returns 1 if the file cannot be read.
+ */
+static int readSysfsLine(char * path, char * line, int size) {
+	FILE * file = fopen(path, "r");
+	if (file == NULL) return 1;
+
+	int failed = fgets(line, size, file) == NULL;
+	fclose(file);
+	return failed;
+}
+
+/*
+ * Reads the L2 and L3 cache sharing of every online CPU, once
+ */
+static void loadTopology() {
+	if (topology.loaded) return;
+	topology.loaded = 1;
+
+	char line[4096], path[PATH_MAX];
+	cpu_set_t online;
+	if (readSysfsLine("/sys/devices/system/cpu/online", line, sizeof(line)) || parseCPUList(line, &online)) return;
+
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		topology.l2Leader[cpu] = topology.l3Leader[cpu] = -1;
+		if (!CPU_ISSET(cpu, &online)) continue;
+		topology.numCPUs = cpu + 1;
+
+		for (int index = 0; index < MAX_CACHE_INDEXES; index++) {
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, index);
+			if (readSysfsLine(path, line, sizeof(line))) break;
+
+			int level = atoi(line);
+			if (level != 2 && level != 3) continue;
+
+			cpu_set_t shared;
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+			if (readSysfsLine(path, line, sizeof(line)) || parseCPUList(line, &shared)) continue;
+
+			/* Identify each cache by the lowest-numbered CPU sharing it */
+			int leader = 0;
+			while (!CPU_ISSET(leader, &shared)) leader++;
+			if (level == 2) topology.l2Leader[cpu] = leader;
+			else topology.l3Leader[cpu] = leader;
+		}
+
+		/* Without an L3 cache, the L2 cache is the largest shared domain */
+		if (topology.l3Leader[cpu] == -1) topology.l3Leader[cpu] = topology.l2Leader[cpu];
+	}
+}
+
+/*
+ * Builtin autopin command: autopin [on|off] turns automatic placement of pipeline stages on or off, or prints its state
+ */
+int autopin(struct Parameter * parameter) {
+	char * state = parameter->arguments[1];
+
+	if (state == NULL) printf("autopin %s\n", autoPlacement ? "on" : "off");
+	else if (!strcmp(state, "on")) autoPlacement = 1;
+	else if (!strcmp(state, "off")) autoPlacement = 0;
+	else {
+		fprintf(stderr, "Error: invalid autopin state\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Turns autopin off and starts spreading pipelines from the first L3 cache domain again, as in a new shell
+ */
+void resetAutoPlacement() {
+	autoPlacement = 0;
+	placedPipelines = 0;
+}
+
+/*
+ * Chooses a CPU set for every stage of a pipeline when autopin is on. All stages are placed in the same L3 cache domain,
+ * each on its own L2 cache (one core and its SMT siblings) in order, so that connected stages share the L3 cache.
+ * Successive pipelines go to successive L3 domains. Returns 0 if stages are not placed automatically.
+ */
+int planAutoPlacement(int numCommands, cpu_set_t stageCPUs[]) {
+	if (!autoPlacement || numCommands < 2) return 0;
+
+	loadTopology();
+	if (topology.numCPUs == 0) return 0;
+
+	/* List the L3 domains, and pick the next one */
+	int domains[CPU_SETSIZE], numDomains = 0;
+	for (int cpu = 0; cpu < topology.numCPUs; cpu++) {
+		if (topology.l3Leader[cpu] == cpu) domains[numDomains++] = cpu;
+	}
+	if (numDomains == 0) return 0;
+	int domain = domains[placedPipelines++ % numDomains];
+
+	/* List the L2 caches of the domain, in CPU order */
+	int groups[CPU_SETSIZE], numGroups = 0;
+	for (int cpu = 0; cpu < topology.numCPUs; cpu++) {
+		if (topology.l3Leader[cpu] == domain && topology.l2Leader[cpu] == cpu) groups[numGroups++] = cpu;
+	}
+
+	/* Give each stage the CPUs of one L2 cache, wrapping around when there are more stages than caches,
+	 * or the whole domain when its L2 caches are unknown */
+	for (int i = 0; i < numCommands; i++) {
+		CPU_ZERO(&stageCPUs[i]);
+		for (int cpu = 0; cpu < topology.numCPUs; cpu++) {
+			if (topology.l3Leader[cpu] != domain) continue;
+			if (numGroups == 0 || topology.l2Leader[cpu] == groups[i % numGroups]) CPU_SET(cpu, &stageCPUs[i]);
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Checks whether the first length characters of an option are exactly one of two names
+ */
+static int optionIs(char * option, size_t length, char * name, char * alias) {
+	return (strlen(name) == length && !strncmp(option, name, length)) || (strlen(alias) == length && !strncmp(option, alias, length));
+}
+
+/*
+ * Parses an I/O scheduling option of pin: a class (rt, be, idle, or 1 to 3), optionally followed by :level (0 to 7)
+ */
+static int parseIOPriority(char * option, int * priority) {
+	char * level = strchr(option, ':');
+	size_t classLength = level != NULL ? (size_t)(level - option) : strlen(option);
+	int ioClass, ioLevel = 4;
+
+	if (optionIs(option, classLength, "rt", "1")) ioClass = 1;
+	else if (optionIs(option, classLength, "be", "2")) ioClass = 2;
+	else if (optionIs(option, classLength, "idle", "3")) ioClass = 3;
+	else return 1;
+
+	if (level != NULL) {
+		char * end;
+		ioLevel = (int)strtol(level + 1, &end, 10);
+		if (end == level + 1 || *end != '\0' || ioLevel < 0 || ioLevel > 7) return 1;
+	}
+
+	/* The idle class has no levels */
+	*priority = (ioClass << IOPRIO_CLASS_SHIFT) | (ioClass == 3 ? 0 : ioLevel);
+	return 0;
+}
+
+/*
+ * Applies the scheduling of a pipeline stage, in the stage's process before it runs:
+ * the options of a "pin [-n adjustment] [-i class[:level]] [cpulist] cmd..." prefix, which is removed from the stage,
+ * or else the automatically planned CPU set, if any. Returns 1 and prints an error if the stage cannot be placed.
+ */
+int applyStagePlacement(struct Parameter * parameter, cpu_set_t * plannedCPUs) {
+	cpu_set_t cpus;
+	cpu_set_t * affinity = plannedCPUs;
+
+	if (!strcmp(parameter->parameterName, "pin")) {
+		char ** args = parameter->arguments + 1;
+		affinity = NULL;
+
+		while (args[0] != NULL && args[0][0] == '-') {
+			/* Niceness adjustment, like nice -n */
+			if (!strcmp(args[0], "-n") && args[1] != NULL) {
+				char * end;
+				long adjustment = strtol(args[1], &end, 10);
+				errno = 0;
+				int niceness = getpriority(PRIO_PROCESS, 0);
+				if (*end != '\0' || end == args[1] || errno || setpriority(PRIO_PROCESS, 0, niceness + (int)adjustment)) {
+					fprintf(stderr, "Error: cannot set priority\n");
+					return 1;
+				}
+			}
+
+			/* I/O scheduling class and level, like ionice -c and -n */
+			else if (!strcmp(args[0], "-i") && args[1] != NULL) {
+				int priority;
+				if (parseIOPriority(args[1], &priority) || syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, priority)) {
+					fprintf(stderr, "Error: cannot set I/O priority\n");
+					return 1;
+				}
+			}
+
+			else {
+				fprintf(stderr, "Error: invalid pin option\n");
+				return 1;
+			}
+
+			args += 2;
+		}
+
+		/* CPU list, recognized by its leading digit */
+		if (args[0] != NULL && args[0][0] >= '0' && args[0][0] <= '9') {
+			if (parseCPUList(args[0], &cpus)) {
+				fprintf(stderr, "Error: invalid CPU list\n");
+				return 1;
+			}
+			affinity = &cpus;
+			args++;
+		}
+
+		if (args[0] == NULL) {
+			fprintf(stderr, "Error: missing command\n");
+			return 1;
+		}
+
+		/* The stage runs the command that follows the pin options */
+		parameter->arguments = args;
+		parameter->parameterName = args[0];
+	}
+
+	if (affinity != NULL && sched_setaffinity(0, sizeof(cpu_set_t), affinity)) {
+		fprintf(stderr, "Error: cannot set CPU affinity\n");
+		return 1;
+	}
+
+	return 0;
+}
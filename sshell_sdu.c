@@ -0,0 +1,384 @@
+#include "sshell_utils.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#define SDU_MAX_THREADS 64
+#define SDU_INODE_BUCKETS 65536
+#define SDU_INODE_LOCKS 256
+
+/*
+ * A directory being measured. Every directory stays alive until its whole subtree has been measured,
+ * so its descriptor can be used by openat for its subdirectories, and its name can be used when printing them.
+ */
+struct DuDirectory {
+	struct DuDirectory * parent;
+	char * name;
+	int fd;
+
+	/* Bytes of the subtree measured so far, and the number of unfinished scans (its own and its subdirectories') */
+	atomic_llong total;
+	atomic_int pending;
+};
+
+/*
+ * Per-thread double-ended queue of directories waiting to be scanned.
+ * The owner pushes and pops at the tail, while idle threads steal from the head.
+ */
+struct DuQueue {
+	pthread_mutex_t lock;
+	struct DuDirectory ** tasks;
+	int head;
+	int tail;
+	int capacity;
+};
+
+/*
+ * Inode already counted, used to count hardlinked files only once
+ */
+struct DuInode {
+	dev_t device;
+	ino_t inode;
+	struct DuInode * next;
+};
+
+/*
+ * State shared by every thread of a single sdu invocation
+ */
+struct DuWalker {
+	int numThreads;
+	struct DuQueue queues[SDU_MAX_THREADS];
+
+	/* Number of directories pushed but not yet scanned, which reaches zero when the walk is done */
+	atomic_long outstanding;
+	atomic_int failed;
+
+	pthread_mutex_t inodeLocks[SDU_INODE_LOCKS];
+	struct DuInode ** inodes;
+};
+
+/*
+ * Arguments of a single worker thread
+ */
+struct DuWorker {
+	struct DuWalker * walker;
+	int index;
+};
+
+/*
+ * Context passed to the directory visitor while scanning a single directory
+ */
+struct DuScan {
+	struct DuWalker * walker;
+	struct DuWorker * worker;
+	struct DuDirectory * directory;
+	long long bytes;
+};
+
+/*
+ * Pushes a directory onto the tail of a queue, growing the queue if needed
+ */
+static void pushDirectory(struct DuWalker * walker, int queueIndex, struct DuDirectory * directory) {
+	struct DuQueue * queue = &walker->queues[queueIndex];
+	atomic_fetch_add(&walker->outstanding, 1);
+
+	pthread_mutex_lock(&queue->lock);
+	if (queue->tail == queue->capacity) {
+		/* Reuse the space left by stolen tasks before growing the queue */
+		if (queue->head > 0) {
+			memmove(queue->tasks, queue->tasks + queue->head, (queue->tail - queue->head) * sizeof(struct DuDirectory *));
+			queue->tail -= queue->head;
+			queue->head = 0;
+		}
+		else {
+			queue->capacity = queue->capacity ? queue->capacity * 2 : 256;
+			queue->tasks = realloc(queue->tasks, queue->capacity * sizeof(struct DuDirectory *));
+		}
+	}
+	queue->tasks[queue->tail++] = directory;
+	pthread_mutex_unlock(&queue->lock);
+}
+
+/*
+ * Pops a directory from the tail (owner) or the head (thief) of a queue, or returns NULL if the queue is empty
+ */
+static struct DuDirectory * takeDirectory(struct DuQueue * queue, int steal) {
+	struct DuDirectory * directory = NULL;
+
+	pthread_mutex_lock(&queue->lock);
+	if (queue->head < queue->tail) {
+		directory = steal ? queue->tasks[queue->head++] : queue->tasks[--queue->tail];
+		if (queue->head == queue->tail) queue->head = queue->tail = 0;
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return directory;
+}
+
+/*
+ * Records an inode as counted. Returns 1 if it was not counted before.
+ */
+static int claimInode(struct DuWalker * walker, struct stat * entryStat) {
+	unsigned long long key = (unsigned long long)entryStat->st_ino * 0x9E3779B97F4A7C15ULL ^ (unsigned long long)entryStat->st_dev;
+	int bucket = (int)((key >> 32) % SDU_INODE_BUCKETS);
+	pthread_mutex_t * lock = &walker->inodeLocks[bucket % SDU_INODE_LOCKS];
+
+	pthread_mutex_lock(lock);
+	for (struct DuInode * cur = walker->inodes[bucket]; cur != NULL; cur = cur->next) {
+		if (cur->inode == entryStat->st_ino && cur->device == entryStat->st_dev) {
+			pthread_mutex_unlock(lock);
+			return 0;
+		}
+	}
+
+	struct DuInode * seen = malloc(sizeof(struct DuInode));
+	seen->device = entryStat->st_dev;
+	seen->inode = entryStat->st_ino;
+	seen->next = walker->inodes[bucket];
+	walker->inodes[bucket] = seen;
+	pthread_mutex_unlock(lock);
+
+	return 1;
+}
+
+/*
+ * Prints the total of a finished directory, building its display path from the names of its ancestors
+ */
+static void printDirectory(struct DuDirectory * directory, long long total) {
+	size_t length = 0;
+	for (struct DuDirectory * cur = directory; cur != NULL; cur = cur->parent) {
+		length += strlen(cur->name) + 1;
+	}
+
+	/* Fill the path from its end, from the directory up to its root */
+	char * path = malloc(length);
+	size_t end = length - 1;
+	path[end] = '\0';
+	for (struct DuDirectory * cur = directory; cur != NULL; cur = cur->parent) {
+		size_t nameLength = strlen(cur->name);
+		end -= nameLength;
+		memcpy(path + end, cur->name, nameLength);
+		if (cur->parent != NULL) path[--end] = '/';
+	}
+
+	printf("%s (%lld bytes)\n", path, total);
+	free(path);
+}
+
+/*
+ * Marks one scan of a directory as finished. When its whole subtree is finished, prints its total,
+ * adds it to its parent and releases it, which in turn may finish the parent.
+ */
+static void finishDirectory(struct DuDirectory * directory) {
+	while (directory != NULL && atomic_fetch_sub(&directory->pending, 1) == 1) {
+		long long total = atomic_load(&directory->total);
+		printDirectory(directory, total);
+
+		struct DuDirectory * parent = directory->parent;
+		if (parent != NULL) atomic_fetch_add(&parent->total, total);
+
+		if (directory->fd != -1) close(directory->fd);
+		free(directory->name);
+		free(directory);
+
+		directory = parent;
+	}
+}
+
+/*
+ * Visits a single entry of a directory being scanned: subdirectories are queued, everything else is counted
+ */
+static void visitDuEntry(int dirfd, char * name, struct stat * entryStat, void * context) {
+	(void)dirfd;
+	struct DuScan * scan = context;
+
+	if (S_ISDIR(entryStat->st_mode)) {
+		struct DuDirectory * child = malloc(sizeof(struct DuDirectory));
+		child->parent = scan->directory;
+		child->name = strdup(name);
+		child->fd = -1;
+		atomic_init(&child->total, (long long)entryStat->st_size);
+		atomic_init(&child->pending, 1);
+
+		/* The child keeps its parent alive until the child's subtree is finished */
+		atomic_fetch_add(&scan->directory->pending, 1);
+		pushDirectory(scan->walker, scan->worker->index, child);
+		return;
+	}
+
+	/* Count files with several hardlinks only the first time one of their links is seen */
+	if (entryStat->st_nlink > 1 && !claimInode(scan->walker, entryStat)) return;
+
+	scan->bytes += entryStat->st_size;
+}
+
+/*
+ * Opens and scans a single directory, queueing its subdirectories
+ */
+static void scanDirectory(struct DuWorker * worker, struct DuDirectory * directory) {
+	struct DuWalker * walker = worker->walker;
+
+	/* Directories are opened relative to their parent, which stays open until all its subdirectories are finished */
+	if (directory->fd == -1) {
+		directory->fd = openat(directory->parent->fd, directory->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	}
+
+	struct DuScan scan = { walker, worker, directory, 0 };
+	if (directory->fd == -1 || readDirectory(directory->fd, AT_SYMLINK_NOFOLLOW, visitDuEntry, &scan)) {
+		fprintf(stderr, "Error: cannot open directory '%s'\n", directory->name);
+		atomic_store(&walker->failed, 1);
+	}
+
+	atomic_fetch_add(&directory->total, scan.bytes);
+	finishDirectory(directory);
+	atomic_fetch_sub(&walker->outstanding, 1);
+}
+
+/*
+ * Worker thread: scans directories from its own queue, and steals from other queues when its own is empty
+ */
+static void * duWorker(void * arg) {
+	struct DuWorker * worker = arg;
+	struct DuWalker * walker = worker->walker;
+	int idleRounds = 0;
+
+	while (1) {
+		struct DuDirectory * directory = takeDirectory(&walker->queues[worker->index], 0);
+
+		/* Try to steal from every other queue, starting after our own */
+		for (int i = 1; directory == NULL && i < walker->numThreads; i++) {
+			directory = takeDirectory(&walker->queues[(worker->index + i) % walker->numThreads], 1);
+		}
+
+		if (directory != NULL) {
+			scanDirectory(worker, directory);
+			idleRounds = 0;
+			continue;
+		}
+
+		/* Nothing left to steal: stop once every queued directory has been scanned */
+		if (atomic_load(&walker->outstanding) == 0) break;
+
+		/* Back off while other threads are still producing work */
+		if (++idleRounds < 16) sched_yield();
+		else nanosleep(&(struct timespec){ 0, 50000 }, NULL);
+	}
+
+	return NULL;
+}
+
+/*
+ * Parses the thread count of sdu's -j option, returning -1 if it is invalid
+ */
+static int parseThreadCount(char * string) {
+	char * end;
+	long threads = strtol(string, &end, 10);
+	if (string[0] == '\0' || *end != '\0' || threads < 1 || threads > SDU_MAX_THREADS) return -1;
+
+	return (int)threads;
+}
+
+/*
+ * Builtin sdu command: parallel recursive disk usage of each directory argument, or "." by default
+ */
+int sdu(struct Parameter * parameter) {
+	char ** args = parameter->arguments + 1;
+
+	/* Use one thread per online CPU unless -j is given */
+	long onlineCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+	int numThreads = onlineCPUs < 1 ? 1 : (onlineCPUs > SDU_MAX_THREADS ? SDU_MAX_THREADS : (int)onlineCPUs);
+
+	if (args[0] != NULL && !strcmp(args[0], "-j")) {
+		if (args[1] == NULL || (numThreads = parseThreadCount(args[1])) == -1) {
+			fprintf(stderr, "Error: invalid thread count\n");
+			return 1;
+		}
+		args += 2;
+	}
+
+	/* Deep trees keep one descriptor open per unfinished directory, so allow as many descriptors as possible during the walk */
+	struct rlimit fileLimit, savedFileLimit;
+	int raisedFileLimit = 0;
+	if (!getrlimit(RLIMIT_NOFILE, &fileLimit) && fileLimit.rlim_cur < fileLimit.rlim_max) {
+		savedFileLimit = fileLimit;
+		fileLimit.rlim_cur = fileLimit.rlim_max;
+		raisedFileLimit = !setrlimit(RLIMIT_NOFILE, &fileLimit);
+	}
+
+	struct DuWalker * walker = calloc(1, sizeof(struct DuWalker));
+	walker->numThreads = numThreads;
+	walker->inodes = calloc(SDU_INODE_BUCKETS, sizeof(struct DuInode *));
+	atomic_init(&walker->outstanding, 0);
+	atomic_init(&walker->failed, 0);
+	for (int i = 0; i < SDU_INODE_LOCKS; i++) pthread_mutex_init(&walker->inodeLocks[i], NULL);
+	for (int i = 0; i < numThreads; i++) pthread_mutex_init(&walker->queues[i].lock, NULL);
+
+	/* Queue every root directory, spreading them over the threads' queues */
+	char * defaultArgs[] = { ".", NULL };
+	if (args[0] == NULL) args = defaultArgs;
+
+	for (int i = 0; args[i] != NULL; i++) {
+		int fd = open(args[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		struct stat rootStat;
+		if (fd == -1 || fstat(fd, &rootStat)) {
+			fprintf(stderr, "Error: cannot open directory '%s'\n", args[i]);
+			if (fd != -1) close(fd);
+			atomic_store(&walker->failed, 1);
+			continue;
+		}
+
+		struct DuDirectory * root = malloc(sizeof(struct DuDirectory));
+		root->parent = NULL;
+		root->name = strdup(args[i]);
+		root->fd = fd;
+		atomic_init(&root->total, (long long)rootStat.st_size);
+		atomic_init(&root->pending, 1);
+		pushDirectory(walker, i % numThreads, root);
+	}
+
+	/* Run the walk with the calling thread acting as worker 0 */
+	pthread_t threads[SDU_MAX_THREADS];
+	struct DuWorker workers[SDU_MAX_THREADS];
+	for (int i = 0; i < numThreads; i++) {
+		workers[i].walker = walker;
+		workers[i].index = i;
+	}
+
+	int numStarted = 1;
+	while (numStarted < numThreads && !pthread_create(&threads[numStarted], NULL, duWorker, &workers[numStarted])) {
+		numStarted++;
+	}
+
+	/* If some threads could not be created, their queues are simply stolen from */
+	duWorker(&workers[0]);
+	for (int i = 1; i < numStarted; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	/* Release the walker */
+	int retval = atomic_load(&walker->failed);
+	for (int i = 0; i < SDU_INODE_BUCKETS; i++) {
+		struct DuInode * cur = walker->inodes[i];
+		while (cur != NULL) {
+			struct DuInode * next = cur->next;
+			free(cur);
+			cur = next;
+		}
+	}
+	for (int i = 0; i < numThreads; i++) {
+		pthread_mutex_destroy(&walker->queues[i].lock);
+		free(walker->queues[i].tasks);
+	}
+	for (int i = 0; i < SDU_INODE_LOCKS; i++) pthread_mutex_destroy(&walker->inodeLocks[i]);
+	free(walker->inodes);
+	free(walker);
+
+	/* Give the commands started afterwards the usual descriptor limit */
+	if (raisedFileLimit) setrlimit(RLIMIT_NOFILE, &savedFileLimit);
+
+	fflush(stdout);
+	return retval;
+}
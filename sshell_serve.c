@@ -0,0 +1,203 @@
+#include "sshell_utils.h"
+
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SERVE_DEFAULT_WORKERS 16
+
+/*
+ * Receives a command line and the client's standard descriptors, and installs the descriptors as the session's own.
+ * Returns 1 when the client is gone or sent a malformed message.
+ */
+static int receiveCommandLine(int connection, char cmd[CMDLINE_MAX]) {
+	char control[CMSG_SPACE(sizeof(int) * SERVE_NUM_FDS)];
+	struct iovec line = { cmd, CMDLINE_MAX - 1 };
+	struct msghdr message = { 0 };
+	message.msg_iov = &line;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+
+	ssize_t length;
+	do {
+		length = recvmsg(connection, &message, MSG_CMSG_CLOEXEC);
+	} while (length == -1 && errno == EINTR);
+
+	if (length <= 0) return 1;
+	cmd[length] = '\0';
+
+	/* Find the passed descriptors, in every header, keeping the first ones and closing any extra ones */
+	int fds[SERVE_NUM_FDS];
+	int numFds = 0;
+	for (struct cmsghdr * header = CMSG_FIRSTHDR(&message); header != NULL; header = CMSG_NXTHDR(&message, header)) {
+		if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) continue;
+
+		int headerFds = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (int i = 0; i < headerFds; i++, numFds++) {
+			int fd;
+			memcpy(&fd, CMSG_DATA(header) + sizeof(int) * i, sizeof(int));
+			if (numFds < SERVE_NUM_FDS) fds[numFds] = fd;
+			else close(fd);
+		}
+	}
+
+	if (numFds != SERVE_NUM_FDS || (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+		for (int i = 0; i < numFds && i < SERVE_NUM_FDS; i++) close(fds[i]);
+		return 1;
+	}
+
+	/* Replace stdin, stdout and stderr with the client's, after flushing what was written to the previous ones */
+	fflush(stdout);
+	fflush(stderr);
+	for (int i = 0; i < SERVE_NUM_FDS; i++) {
+		dup2(fds[i], i);
+		close(fds[i]);
+	}
+
+	/* Remove trailing newline from command line */
+	char *nl;
+	nl = strchr(cmd, '\n');
+	if (nl) *nl = '\0';
+
+	return 0;
+}
+
+/*
+ * Runs the command lines of a single client, one after the other, until it disconnects or runs exit
+ */
+static void serveSession(int connection) {
+	char cmd[CMDLINE_MAX];
+
+	while (!receiveCommandLine(connection, cmd)) {
+		struct ServeReply reply;
+		memset(&reply, 0, sizeof(reply));
+		reply.exitRequested = executeCommandLine(cmd, reply.statuses, &reply.numStatuses);
+
+		fflush(stdout);
+		fflush(stderr);
+		if (send(connection, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply) || reply.exitRequested) break;
+	}
+
+	close(connection);
+}
+
+/*
+ * Worker process: serves one client at a time. The server's working directory, autopin state and standard descriptors
+ * are restored between clients, so that builtins such as cd and autopin only affect their own session, and clients see
+ * the end of their output.
+ */
+static void serveWorker(int listenfd) {
+	/* Stop along with the server */
+	prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+	int serverDirectory = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	int serverFds[SERVE_NUM_FDS];
+	for (int i = 0; i < SERVE_NUM_FDS; i++) {
+		serverFds[i] = fcntl(i, F_DUPFD_CLOEXEC, SERVE_NUM_FDS);
+	}
+
+	while (1) {
+		int connection = accept4(listenfd, NULL, NULL, SOCK_CLOEXEC);
+		if (connection == -1) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			perror("accept");
+			exit(1);
+		}
+
+		serveSession(connection);
+
+		fflush(stdout);
+		fflush(stderr);
+		for (int i = 0; i < SERVE_NUM_FDS; i++) {
+			if (serverFds[i] != -1) dup2(serverFds[i], i);
+		}
+		if (serverDirectory != -1 && fchdir(serverDirectory)) perror("fchdir");
+		resetAutoPlacement();
+	}
+}
+
+/*
+ * Number of worker processes, which is the number of clients served concurrently: $SSHELL_SERVE_WORKERS, or SERVE_DEFAULT_WORKERS
+ */
+static int getWorkerCount() {
+	char * configured = getenv("SSHELL_SERVE_WORKERS");
+	int workers = configured != NULL ? atoi(configured) : 0;
+
+	return workers > 0 ? workers : SERVE_DEFAULT_WORKERS;
+}
+
+/*
+ * Starts a worker process, returning its PID
+ */
+static pid_t startWorker(int listenfd) {
+	pid_t processID = fork();
+
+	if (processID == 0) {
+		serveWorker(listenfd);
+		exit(0);
+	}
+
+	if (processID == -1) perror("fork");
+	return processID;
+}
+
+/*
+ * Command server mode: accepts clients on a Unix socket, and runs the command lines they send with their own standard descriptors
+ */
+int serveCommands(char * socketPath) {
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	if (strlen(socketPath) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "Error: socket path too long\n");
+		return EXIT_FAILURE;
+	}
+	strcpy(address.sun_path, socketPath);
+
+	/* Sequenced packets keep every command line and reply in a single message */
+	int listenfd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (listenfd == -1) {
+		perror("socket");
+		return EXIT_FAILURE;
+	}
+
+	/* Replace the socket of a previous server, but never a file of another kind */
+	struct stat socketStat;
+	if (!lstat(socketPath, &socketStat)) {
+		if (!S_ISSOCK(socketStat.st_mode)) {
+			fprintf(stderr, "Error: socket path exists and is not a socket\n");
+			close(listenfd);
+			return EXIT_FAILURE;
+		}
+		unlink(socketPath);
+	}
+	if (bind(listenfd, (struct sockaddr *)&address, sizeof(address)) || listen(listenfd, SOMAXCONN)) {
+		perror("bind");
+		close(listenfd);
+		return EXIT_FAILURE;
+	}
+
+	/* Workers are forked once from the already initialized server, and all accept clients from the same socket,
+	 * so that a client costs neither a process startup nor a fork */
+	int numWorkers = getWorkerCount();
+	for (int i = 0; i < numWorkers; i++) {
+		if (startWorker(listenfd) == -1) break;
+	}
+
+	/* Replace workers that die, for example when a client's command line kills its own session */
+	while (1) {
+		pid_t processID = wait(NULL);
+		if (processID == -1) {
+			if (errno == EINTR) continue;
+			break;
+		}
+
+		startWorker(listenfd);
+	}
+
+	close(listenfd);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,432 @@
+#include "sshell_utils.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SSHELL_X86 1
+#endif
+
+#define TEXT_READ_SIZE (1 << 20)
+
+/*
+ * Running counts of scount. prevSpace records whether the byte before the current chunk was whitespace,
+ * so that words spanning two chunks are only counted once.
+ */
+struct TextCounts {
+	long long lines;
+	long long words;
+	long long bytes;
+	unsigned prevSpace;
+};
+
+/*
+ * Running state of sgrep over a single input
+ */
+struct TextSearch {
+	const unsigned char * pattern;
+	size_t patternLength;
+	char * fileName;
+	int countOnly;
+	long long matches;
+};
+
+/*
+ * Kernels selected once at runtime, depending on the instruction sets supported by the CPU
+ */
+typedef void (*CountKernel)(const unsigned char * buf, size_t len, struct TextCounts * counts);
+typedef const unsigned char * (*FindKernel)(const unsigned char * haystack, size_t len, const unsigned char * needle, size_t needleLength);
+
+/*
+ * Checks whether a byte is whitespace in the C locale: space, or \t \n \v \f \r
+ */
+static int isSpaceByte(unsigned char c) {
+	return c == ' ' || (unsigned char)(c - '\t') <= 4;
+}
+
+/*
+ * Scalar line, word and byte counting
+ */
+static void countScalar(const unsigned char * buf, size_t len, struct TextCounts * counts) {
+	unsigned prevSpace = counts->prevSpace;
+
+	for (size_t i = 0; i < len; i++) {
+		unsigned space = isSpaceByte(buf[i]);
+		counts->lines += buf[i] == '\n';
+		counts->words += (space ^ 1) & prevSpace;
+		prevSpace = space;
+	}
+
+	counts->bytes += len;
+	counts->prevSpace = prevSpace;
+}
+
+/*
+ * Scalar fixed-string search, returning the first occurrence of the needle or NULL
+ */
+static const unsigned char * findScalar(const unsigned char * haystack, size_t len, const unsigned char * needle, size_t needleLength) {
+	return memmem(haystack, len, needle, needleLength);
+}
+
+#ifdef SSHELL_X86
+/*
+ * SSE2 counting, 16 bytes at a time. Words are counted as non-whitespace bytes preceded by whitespace.
+ */
+__attribute__((target("sse2")))
+static void countSSE2(const unsigned char * buf, size_t len, struct TextCounts * counts) {
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i four = _mm_set1_epi8(4);
+	unsigned prevSpace = counts->prevSpace;
+	size_t i = 0;
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i block = _mm_loadu_si128((const __m128i *)(buf + i));
+
+		/* \t to \r are the bytes whose distance from \t is at most 4 */
+		__m128i control = _mm_sub_epi8(block, tab);
+		__m128i isControl = _mm_cmpeq_epi8(_mm_min_epu8(control, four), control);
+		unsigned whitespace = (unsigned)_mm_movemask_epi8(_mm_or_si128(isControl, _mm_cmpeq_epi8(block, space)));
+		unsigned newlines = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+
+		unsigned wordStarts = ~whitespace & ((whitespace << 1) | prevSpace) & 0xFFFF;
+		counts->lines += __builtin_popcount(newlines);
+		counts->words += __builtin_popcount(wordStarts);
+		prevSpace = whitespace >> 15;
+	}
+
+	counts->prevSpace = prevSpace;
+	countScalar(buf + i, len - i, counts);
+	counts->bytes += i;
+}
+
+/*
+ * AVX2 counting, 32 bytes at a time, with the same approach as countSSE2
+ */
+__attribute__((target("avx2,popcnt")))
+static void countAVX2(const unsigned char * buf, size_t len, struct TextCounts * counts) {
+	const __m256i newline = _mm256_set1_epi8('\n');
+	const __m256i space = _mm256_set1_epi8(' ');
+	const __m256i tab = _mm256_set1_epi8('\t');
+	const __m256i four = _mm256_set1_epi8(4);
+	uint32_t prevSpace = counts->prevSpace;
+	size_t i = 0;
+
+	for (; i + 32 <= len; i += 32) {
+		__m256i block = _mm256_loadu_si256((const __m256i *)(buf + i));
+
+		__m256i control = _mm256_sub_epi8(block, tab);
+		__m256i isControl = _mm256_cmpeq_epi8(_mm256_min_epu8(control, four), control);
+		uint32_t whitespace = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(isControl, _mm256_cmpeq_epi8(block, space)));
+		uint32_t newlines = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+
+		uint32_t wordStarts = ~whitespace & ((whitespace << 1) | prevSpace);
+		counts->lines += __builtin_popcount(newlines);
+		counts->words += __builtin_popcount(wordStarts);
+		prevSpace = whitespace >> 31;
+	}
+
+	counts->prevSpace = prevSpace;
+	countScalar(buf + i, len - i, counts);
+	counts->bytes += i;
+}
+
+/*
+ * SSE2 search: compares 16 candidate positions at once against the needle's first and last bytes,
+ * and only runs memcmp on the positions where both match
+ */
+__attribute__((target("sse2")))
+static const unsigned char * findSSE2(const unsigned char * haystack, size_t len, const unsigned char * needle, size_t needleLength) {
+	if (needleLength < 2) return findScalar(haystack, len, needle, needleLength);
+
+	const __m128i first = _mm_set1_epi8((char)needle[0]);
+	const __m128i last = _mm_set1_epi8((char)needle[needleLength - 1]);
+	size_t i = 0;
+
+	for (; i + needleLength - 1 + 16 <= len; i += 16) {
+		__m128i blockFirst = _mm_loadu_si128((const __m128i *)(haystack + i));
+		__m128i blockLast = _mm_loadu_si128((const __m128i *)(haystack + i + needleLength - 1));
+		unsigned candidates = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, last)));
+
+		while (candidates) {
+			int bit = __builtin_ctz(candidates);
+			if (!memcmp(haystack + i + bit + 1, needle + 1, needleLength - 2)) return haystack + i + bit;
+			candidates &= candidates - 1;
+		}
+	}
+
+	return findScalar(haystack + i, len - i, needle, needleLength);
+}
+
+/*
+ * AVX2 search, 32 candidate positions at a time, with the same approach as findSSE2
+ */
+__attribute__((target("avx2")))
+static const unsigned char * findAVX2(const unsigned char * haystack, size_t len, const unsigned char * needle, size_t needleLength) {
+	if (needleLength < 2) return findScalar(haystack, len, needle, needleLength);
+
+	const __m256i first = _mm256_set1_epi8((char)needle[0]);
+	const __m256i last = _mm256_set1_epi8((char)needle[needleLength - 1]);
+	size_t i = 0;
+
+	for (; i + needleLength - 1 + 32 <= len; i += 32) {
+		__m256i blockFirst = _mm256_loadu_si256((const __m256i *)(haystack + i));
+		__m256i blockLast = _mm256_loadu_si256((const __m256i *)(haystack + i + needleLength - 1));
+		uint32_t candidates = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockLast, last)));
+
+		while (candidates) {
+			int bit = __builtin_ctz(candidates);
+			if (!memcmp(haystack + i + bit + 1, needle + 1, needleLength - 2)) return haystack + i + bit;
+			candidates &= candidates - 1;
+		}
+	}
+
+	return findScalar(haystack + i, len - i, needle, needleLength);
+}
+#endif
+
+/*
+ * Kernels in use, chosen by selectKernels
+ */
+static CountKernel countKernel = countScalar;
+static FindKernel findKernel = findScalar;
+
+/*
+ * Chooses the widest kernels supported by the CPU. SSHELL_SIMD=scalar, sse2 or avx2 limits the choice, for benchmarking.
+ */
+static void selectKernels() {
+	static int selected = 0;
+	if (selected) return;
+	selected = 1;
+
+#ifdef SSHELL_X86
+	char * limit = getenv("SSHELL_SIMD");
+	if (limit != NULL && !strcmp(limit, "scalar")) return;
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && (limit == NULL || !strcmp(limit, "avx2"))) {
+		countKernel = countAVX2;
+		findKernel = findAVX2;
+	}
+	else if (__builtin_cpu_supports("sse2")) {
+		countKernel = countSSE2;
+		findKernel = findSSE2;
+	}
+#endif
+}
+
+/*
+ * Passes the rest of an input, from its current position, to the consumer, and leaves the input at its end, like read would.
+ * Regular files are mapped in one piece. Other inputs are read in large chunks; when lineAligned is set,
+ * every chunk but the last ends with a newline. Returns 1 on a read error.
+ */
+static int forEachChunk(int fd, int lineAligned, void (*consume)(const unsigned char * buf, size_t len, void * context), void * context) {
+	struct stat inputStat;
+	off_t offset = lseek(fd, 0, SEEK_CUR);
+	if (offset != -1 && !fstat(fd, &inputStat) && S_ISREG(inputStat.st_mode) && inputStat.st_size > offset) {
+		/* Mappings start at a page boundary, such as for a script that was partly read as the shell's stdin */
+		off_t mapStart = offset & ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+		size_t mapLength = inputStat.st_size - mapStart;
+
+		void * mapping = mmap(NULL, mapLength, PROT_READ, MAP_PRIVATE, fd, mapStart);
+		if (mapping != MAP_FAILED) {
+			madvise(mapping, mapLength, MADV_SEQUENTIAL);
+			consume((unsigned char *)mapping + (offset - mapStart), inputStat.st_size - offset, context);
+			munmap(mapping, mapLength);
+			lseek(fd, inputStat.st_size, SEEK_SET);
+			return 0;
+		}
+	}
+
+	/* Keep the incomplete last line of each read at the front of the buffer, for the next read */
+	size_t capacity = TEXT_READ_SIZE, filled = 0;
+	unsigned char * buf = malloc(capacity);
+	ssize_t bytesRead;
+
+	while ((bytesRead = read(fd, buf + filled, capacity - filled)) != 0) {
+		if (bytesRead == -1) {
+			if (errno == EINTR) continue;
+			free(buf);
+			return 1;
+		}
+		filled += bytesRead;
+
+		size_t ready = filled;
+		if (lineAligned) {
+			unsigned char * lastNewline = memrchr(buf, '\n', filled);
+			ready = lastNewline == NULL ? 0 : (size_t)(lastNewline - buf) + 1;
+		}
+
+		if (ready > 0) consume(buf, ready, context);
+		memmove(buf, buf + ready, filled - ready);
+		filled -= ready;
+
+		/* A single line fills the buffer, so make room for the rest of it */
+		if (filled == capacity) {
+			capacity *= 2;
+			buf = realloc(buf, capacity);
+		}
+	}
+
+	if (filled > 0) consume(buf, filled, context);
+	free(buf);
+	return 0;
+}
+
+/*
+ * Opens an input file argument, or returns stdin for a missing argument or "-"
+ */
+static int openInput(char * fileName) {
+	if (fileName == NULL || !strcmp(fileName, "-")) return STDIN_FILENO;
+	return open(fileName, O_RDONLY | O_CLOEXEC);
+}
+
+/*
+ * Consumer for scount, counting a chunk with the selected kernel
+ */
+static void countChunk(const unsigned char * buf, size_t len, void * context) {
+	countKernel(buf, len, context);
+}
+
+/*
+ * Prints the counts selected by scount's options, followed by the file name if any
+ */
+static void printCounts(struct TextCounts * counts, int showLines, int showWords, int showBytes, char * name) {
+	int printed = 0;
+	if (showLines) printf("%s%lld", printed++ ? " " : "", counts->lines);
+	if (showWords) printf("%s%lld", printed++ ? " " : "", counts->words);
+	if (showBytes) printf("%s%lld", printed++ ? " " : "", counts->bytes);
+	if (name != NULL) printf(" %s", name);
+	printf("\n");
+}
+
+/*
+ * Builtin scount command: counts lines, words and bytes of each file, or of stdin by default
+ */
+int scount(struct Parameter * parameter) {
+	char ** args = parameter->arguments + 1;
+	int showLines = 0, showWords = 0, showBytes = 0;
+
+	/* Parse the -l, -w and -c options, which may be combined */
+	for (; args[0] != NULL && args[0][0] == '-' && args[0][1] != '\0'; args++) {
+		for (int i = 1; args[0][i] != '\0'; i++) {
+			if (args[0][i] == 'l') showLines = 1;
+			else if (args[0][i] == 'w') showWords = 1;
+			else if (args[0][i] == 'c') showBytes = 1;
+			else {
+				fprintf(stderr, "Error: invalid option\n");
+				return 1;
+			}
+		}
+	}
+
+	/* Show every count if no count was selected */
+	if (!showLines && !showWords && !showBytes) showLines = showWords = showBytes = 1;
+
+	selectKernels();
+
+	int retval = 0, numFiles = 0;
+	struct TextCounts total = { 0, 0, 0, 1 };
+
+	do {
+		int fd = openInput(args[0]);
+		struct TextCounts counts = { 0, 0, 0, 1 };
+
+		if (fd == -1 || forEachChunk(fd, 0, countChunk, &counts)) {
+			fprintf(stderr, "Error: cannot read file '%s'\n", args[0] != NULL ? args[0] : "-");
+			retval = 1;
+		}
+		else {
+			printCounts(&counts, showLines, showWords, showBytes, args[0]);
+			total.lines += counts.lines;
+			total.words += counts.words;
+			total.bytes += counts.bytes;
+		}
+
+		if (fd > STDIN_FILENO) close(fd);
+		numFiles++;
+	} while (args[0] != NULL && (++args)[0] != NULL);
+
+	if (numFiles > 1) printCounts(&total, showLines, showWords, showBytes, "total");
+
+	return retval;
+}
+
+/*
+ * Consumer for sgrep, printing or counting every line of a chunk that contains the pattern.
+ * Chunks always start at the beginning of a line.
+ */
+static void searchChunk(const unsigned char * buf, size_t len, void * context) {
+	struct TextSearch * search = context;
+	const unsigned char * cur = buf;
+	const unsigned char * end = buf + len;
+
+	while (cur < end) {
+		const unsigned char * match = findKernel(cur, end - cur, search->pattern, search->patternLength);
+		if (match == NULL) break;
+
+		/* Expand the match to its whole line */
+		const unsigned char * lineStart = memrchr(cur, '\n', match - cur);
+		lineStart = lineStart == NULL ? cur : lineStart + 1;
+		const unsigned char * lineEnd = memchr(match, '\n', end - match);
+		if (lineEnd == NULL) lineEnd = end;
+
+		search->matches++;
+		if (!search->countOnly) {
+			if (search->fileName != NULL) printf("%s:", search->fileName);
+			fwrite(lineStart, 1, lineEnd - lineStart, stdout);
+			putchar('\n');
+		}
+
+		cur = lineEnd + 1;
+	}
+}
+
+/*
+ * Builtin sgrep command: prints the lines of each file, or of stdin by default, that contain a fixed string
+ */
+int sgrep(struct Parameter * parameter) {
+	char ** args = parameter->arguments + 1;
+	int countOnly = 0;
+
+	if (args[0] != NULL && !strcmp(args[0], "-c")) {
+		countOnly = 1;
+		args++;
+	}
+
+	if (args[0] == NULL) {
+		fprintf(stderr, "Error: missing pattern\n");
+		return 2;
+	}
+
+	selectKernels();
+
+	/* Prefix lines with their file name when searching several files, like grep */
+	char * pattern = args[0];
+	int multipleFiles = args[1] != NULL && args[2] != NULL;
+	int retval = 1;
+	args++;
+
+	do {
+		int fd = openInput(args[0]);
+		struct TextSearch search = { (const unsigned char *)pattern, strlen(pattern), multipleFiles ? args[0] : NULL, countOnly, 0 };
+
+		if (fd == -1 || forEachChunk(fd, 1, searchChunk, &search)) {
+			fprintf(stderr, "Error: cannot read file '%s'\n", args[0] != NULL ? args[0] : "-");
+			retval = 2;
+		}
+		else {
+			if (countOnly) {
+				if (search.fileName != NULL) printf("%s:", search.fileName);
+				printf("%lld\n", search.matches);
+			}
+			if (search.matches > 0 && retval == 1) retval = 0;
+		}
+
+		if (fd > STDIN_FILENO) close(fd);
+	} while (args[0] != NULL && (++args)[0] != NULL);
+
+	return retval;
+}
@@ -42,6 +42,7 @@ void freeParameterArray(struct Parameter * parameters[]){
 	for (int i=0; parameters[i]!=NULL; i++) {
 		/* Individual arguments are freed within freeArgArray, and only the structs are freed in this function */
 		free(parameters[i]->arguments);
+		free(parameters[i]->executablePath);
 		free(parameters[i]);
 	}
 	
@@ -110,6 +111,7 @@ void argsToParameterList(char ** args, int numParameters, struct Parameter ** pa
 			struct Parameter * curParameter = malloc(sizeof(struct Parameter));
 			curParameter->parameterName = curArgs[0];
 			curParameter->arguments = curArgs;
+			curParameter->executablePath = NULL;
 
 			/* Add the newly-created Parameter to the array of Parameter pointers */
 			paramArray[parameterIndex] = curParameter;
@@ -137,6 +139,7 @@ void argsToParameterList(char ** args, int numParameters, struct Parameter ** pa
 	struct Parameter * curParameter = malloc(sizeof(struct Parameter));
 	curParameter->parameterName = curArgs[0];
 	curParameter->arguments = curArgs;
+	curParameter->executablePath = NULL;
 
 	/* Add the newly-created Parameter to the array of Parameter pointers */
 	paramArray[parameterIndex] = curParameter;
@@ -378,38 +381,84 @@ char ** parseArgs(char cmd[], int numArgs) {
 }
 
 /*
- * Builtin sls command
+ * Reads every entry of an open directory, skipping "." and "..", and passes each entry's stats to the visitor.
+ * Entries are stat'ed relative to dirfd, and the directory is read through a duplicate of dirfd, so the caller keeps ownership of it.
  */
-int sls() {
-	/* Try to open the current directory */
-	DIR *curDirectory;
-	curDirectory = opendir(".");
-
-	if (curDirectory == NULL) {
-		fprintf(stderr, "Error: cannot open directory\n");
+int readDirectory(int dirfd, int statFlags, void (*visitEntry)(int dirfd, char * name, struct stat * entryStat, void * context), void * context) {
+	/* Open a directory stream on a duplicate, because closedir closes the descriptor it was given */
+	int streamfd = dup(dirfd);
+	if (streamfd == -1) return 1;
+
+	DIR *directory = fdopendir(streamfd);
+	if (directory == NULL) {
+		close(streamfd);
 		return 1;
 	}
 
-	/* Iterate through entries in current directory */
+	/* Iterate through entries in the directory */
 	struct dirent *entry;
-	while ((entry = readdir(curDirectory)) != NULL) {
+	while ((entry = readdir(directory)) != NULL) {
 		char * name = entry->d_name;
 
-		/* Ignore the current directory and the parent directory */
-		if (name[0] == '.') continue;
+		/* Ignore the directory itself and the parent directory */
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+		/* Get the stats of the current entry, skipping entries that disappeared while reading */
+		struct stat entryStat;
+		if (fstatat(dirfd, name, &entryStat, statFlags)) continue;
+
+		visitEntry(dirfd, name, &entryStat, context);
+	}
+
+	closedir(directory);
+	return 0;
+}
+
+/*
+ * Prints a single entry of the sls listing
+ */
+static void printSlsEntry(int dirfd, char * name, struct stat * entryStat, void * context) {
+	(void)dirfd;
+	(void)context;
+
+	/* Ignore hidden files */
+	if (name[0] == '.') return;
 
-		/* Get the stats of the current entry */
-		struct stat curFile;
-		stat(name, &curFile);
-		long long fileSize = curFile.st_size;
+	long long fileSize = entryStat->st_size;
+	printf("%s (%lld bytes)\n", name, fileSize);
+}
 
-		printf("%s (%lld bytes)\n", name, fileSize);
+/*
+ * Builtin sls command
+ */
+int sls() {
+	/* Try to open the current directory */
+	int curDirectory = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	if (curDirectory == -1 || readDirectory(curDirectory, 0, printSlsEntry, NULL)) {
+		fprintf(stderr, "Error: cannot open directory\n");
+		if (curDirectory != -1) close(curDirectory);
+		return 1;
 	}
 
-	closedir(curDirectory);
+	close(curDirectory);
 	return 0;
 }
 
+/*
+ * Runs a builtin that can act as a pipeline stage, inside the stage's process instead of executing a program.
+ * Returns 1 and sets the builtin's exit status if the command is such a builtin, or 0 otherwise.
+ */
+int runStageBuiltin(struct Parameter * parameter, int * retval) {
+	if (!strcmp(parameter->parameterName, "scount")) *retval = scount(parameter);
+	else if (!strcmp(parameter->parameterName, "sgrep")) *retval = sgrep(parameter);
+	else if (!strcmp(parameter->parameterName, "scat")) *retval = scat(parameter);
+	else if (!strcmp(parameter->parameterName, "sdu")) *retval = sdu(parameter);
+	else return 0;
+
+	return 1;
+}
+
 /*
  * Builtin cd command
  */
@@ -470,26 +519,106 @@ int getParametersAndRedirects(char cmd[], struct Parameter ** parameters[], char
 }
 
 /*
- * Executes the entire pipeline
+ * Parses a command line, without its trailing newline, into a ParsedLine. Empty lines are left without Parameters.
+ */
+void parseCommandLine(char cmd[], struct ParsedLine * line) {
+	memset(line, 0, sizeof(struct ParsedLine));
+	line->resolvedGeneration = -1;
+	strncpy(line->cmd, cmd, CMDLINE_MAX - 1);
+
+	/* If the user entered only whitespace, discard the input without parsing */
+	if (isEmptyCommand(line->cmd)) return;
+
+	/* Parse a copy of the command, in which parseAppends will replace all >>, and keep the original for the completed message */
+	char parsedCmd[CMDLINE_MAX];
+	memcpy(parsedCmd, line->cmd, CMDLINE_MAX);
+
+	line->parseRetval = getParametersAndRedirects(parsedCmd, &line->parameters, &line->redirects, &line->argArray, &line->parameterCount);
+}
+
+/*
+ * Deallocates the Parameters, redirects and arguments of a ParsedLine
+ */
+void freeParsedLine(struct ParsedLine * line) {
+	/* No parameters are created for empty lines or in the case of a parsing error, so nothing needs to be freed */
+	if (line->parameters == NULL || line->parseRetval != NO_ERRORS) return;
+
+	freeParameterArray(line->parameters);
+	free(line->redirects);
+	freeArgArray(line->argArray);
+	line->parameters = NULL;
+}
+
+/*
+ * Function run while the shell waits for a pipeline, such as the look-ahead of batch mode, or NULL
+ */
+static void (*pipelineWaitHook)() = NULL;
+
+/*
+ * Whether the wait hook is skipped, such as while pipelines are timed
+ */
+static int pipelineWaitHookPaused = 0;
+
+/*
+ * Sets the function run while the shell waits for a pipeline, after all of its commands are started
+ */
+void setPipelineWaitHook(void (*hook)()) {
+	pipelineWaitHook = hook;
+}
+
+/*
+ * Skips or runs again the function run while the shell waits for a pipeline
  */
-void executePipeline(struct Parameter ** commands, int numCommands, char * cmd) {
-	/* Create arrays of pipes, PIDs, and return values */
+void pausePipelineWaitHook(int paused) {
+	pipelineWaitHookPaused = paused;
+}
+
+/*
+ * Runs the pipeline and waits for it, storing the wait status of every command in statuses.
+ * Returns 1 if the pipes or processes could not be created, or the time limits of its stages cannot be enforced.
+ */
+int runPipeline(struct Parameter ** commands, int numCommands, int statuses[]) {
+	/* Create arrays of pipes and PIDs */
 	int pipefds[numCommands - 1][2];
 	pid_t childPIDs[numCommands];
 
 	/* Default all return values to 0, assume successful execution */
-	int retvals[numCommands];
-	memset(retvals, 0, numCommands * sizeof(int));
+	memset(statuses, 0, numCommands * sizeof(int));
 
-	/* Initialize pipes, but exit if any error occurs during initialization */
+	/* Find the time limits of the stages, which the shell enforces while waiting, and never run them without it */
+	long long timeouts[numCommands];
+	int timeLimited = 0;
+	for (int i = 0; i < numCommands; i++) {
+		timeouts[i] = getStageTimeout(commands[i]);
+		if (timeouts[i] > 0) timeLimited = 1;
+	}
+
+	if (timeLimited && !timeLimitsSupported()) {
+		fprintf(stderr, "Error: cannot enforce time limit\n");
+		return 1;
+	}
+
+	/* Initialize pipes, but stop if any error occurs during initialization */
 	for (int i = 0; i < numCommands - 1; i++) {
 		if (pipe(pipefds[i]) == -1) {
 			perror("pipe");
-			exit(1);
+			for (int j = 0; j < i; j++) {
+				close(pipefds[j][0]);
+				close(pipefds[j][1]);
+			}
+			return 1;
 		}
 	}
 
+	/* Plan the CPUs of every command when stages are placed automatically */
+	cpu_set_t stageCPUs[numCommands];
+	int autoPlaced = planAutoPlacement(numCommands, stageCPUs);
+
+	/* Time limits count from the start of the pipeline */
+	long long startTime = timeLimited ? monotonicMilliseconds() : 0;
+
 	/* Connect every command to a pipe */
+	int numStarted = 0;
 	for (int i = 0; i < numCommands; i++) {
 		pid_t processID;
 
@@ -524,8 +653,26 @@ void executePipeline(struct Parameter ** commands, int numCommands, char * cmd)
 				}
 			}
 
-			/* Execute the command */
-			retvals[i] = execvp(commands[i]->parameterName, commands[i]->arguments);
+			/* Apply the stage's resource limits and then its CPU affinity and priorities, removing its limit and pin prefixes,
+			 * which may come in any order */
+			char * commandName = commands[i]->parameterName;
+			int failed = applyStageLimits(commands[i]) || applyStagePlacement(commands[i], autoPlaced ? &stageCPUs[i] : NULL);
+			while (!failed && (!strcmp(commands[i]->parameterName, "limit") || !strcmp(commands[i]->parameterName, "pin"))) {
+				failed = applyStageLimits(commands[i]) || applyStagePlacement(commands[i], NULL);
+			}
+			if (failed) exit(1);
+
+			/* Run builtin stages in place, skipping the exec */
+			int builtinRetval;
+			if (runStageBuiltin(commands[i], &builtinRetval)) {
+				exit(builtinRetval);
+			}
+
+			/* Execute the command, directly from its executable when it was found ahead of time and the stage has no prefix */
+			if (commands[i]->executablePath != NULL && commands[i]->parameterName == commandName) {
+				execv(commands[i]->executablePath, commands[i]->arguments);
+			}
+			execvp(commands[i]->parameterName, commands[i]->arguments);
 
 			/* If control returns to the child, execvp has failed */
 			fprintf(stderr, "Error: command not found\n");
@@ -535,12 +682,13 @@ void executePipeline(struct Parameter ** commands, int numCommands, char * cmd)
 		/* Parent process - save the child's PID */
 		else if (processID > 0) {
 			childPIDs[i] = processID;
+			numStarted++;
 		}
 
-		/* Fork error, return immediately */
+		/* Fork error, stop starting commands */
 		else {
 			perror("fork");
-			exit(1);
+			break;
 		}
 	}
 
@@ -550,20 +698,77 @@ void executePipeline(struct Parameter ** commands, int numCommands, char * cmd)
 		close(pipefds[i][1]);
 	}
 
-	/* Wait for all children to finish executing */
-	for (int i = 0; i < numCommands; i++) {
-		waitpid(childPIDs[i], &(retvals[i]), 0);
+	/* Use the wait for other work */
+	if (pipelineWaitHook != NULL && !pipelineWaitHookPaused) pipelineWaitHook();
+
+	/* Wait for all started children to finish executing, timing out time-limited pipelines */
+	if (timeLimited && numStarted == numCommands) {
+		waitWithTimeouts(childPIDs, numCommands, startTime, timeouts, statuses);
+		return 0;
+	}
+
+	for (int i = 0; i < numStarted; i++) {
+		waitpid(childPIDs[i], &(statuses[i]), 0);
 	}
 
-	/* Print completed message, followed by the exit statuses of all the processes */
+	return numStarted < numCommands;
+}
+
+/*
+ * Prints the completed message, followed by the exit statuses of all the processes
+ */
+void printCompleted(char * cmd, int statuses[], int numCommands) {
 	fprintf(stderr, "+ completed '%s' ", cmd);
 	for (int i=0; i<numCommands; i++) {
-		fprintf(stderr, "[%d]", WEXITSTATUS(retvals[i]));
+		fprintf(stderr, "[%d]", WEXITSTATUS(statuses[i]));
 	}
 
 	fprintf(stderr, "\n");
 }
 
+/*
+ * Executes the entire pipeline, with its output sent to stdout or to the output file, and prints its completed message.
+ * Stores the wait status of every command in statuses. Returns 1 if the pipeline could not be started.
+ */
+int executePipeline(struct Parameter ** commands, int numCommands, int outputMode, char * outputFile, char * cmd, int statuses[]) {
+	/* Point the shell's own stdout at the output file while the pipeline starts, and restore it afterwards */
+	fflush(stdout);
+	int savedStdout = -1;
+	if (outputMode != WRITE_TO_STDOUT) {
+		savedStdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+
+		/* Try to set file output- if it fails, print an error message and return */
+		if (savedStdout == -1 || stdoutRedirect(outputMode, outputFile)) {
+			fprintf(stderr, "Error: cannot open output file\n");
+			if (savedStdout != -1) close(savedStdout);
+			return 1;
+		}
+	}
+
+	int failed = runPipeline(commands, numCommands, statuses);
+
+	if (savedStdout != -1) {
+		dup2(savedStdout, STDOUT_FILENO);
+		close(savedStdout);
+	}
+
+	if (failed) return 1;
+
+	printCompleted(cmd, statuses, numCommands);
+	return 0;
+}
+
+/*
+ * Opens the output file of a redirect, with truncate or append depending on the output mode, closed on exec
+ * so that commands only get it as their stdout. Returns the file descriptor, or -1 if the file cannot be opened.
+ */
+int openOutputFile(int outputMode, char * outputFile) {
+	if (outputMode == WRITE_TO_FILE) return open(outputFile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	else if (outputMode == APPEND_TO_FILE) return open(outputFile, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+	return -1;
+}
+
 /*
  * Redirect stdout, with the given parameters
  */
@@ -571,9 +776,7 @@ int stdoutRedirect(int outputMode, char * outputFile) {
 	/* Redirect output to a file if not writing to stdout- otherwise, do nothing, as output goes to stdout by default */
 	if (outputMode != WRITE_TO_STDOUT) {
 		/* Open the output file with truncate or append, depending on the parameters */
-		int fd;
-		if (outputMode == WRITE_TO_FILE) fd = open(outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-		else if (outputMode == APPEND_TO_FILE) fd = open(outputFile, O_WRONLY | O_CREAT | O_APPEND, 0644);
+		int fd = openOutputFile(outputMode, outputFile);
 
 		/* If unable to open the file, return */
 		if (fd == -1) {
@@ -585,4 +788,4 @@ int stdoutRedirect(int outputMode, char * outputFile) {
 		close(fd);
 	}
 	return 0;
-}
\ No newline at end of file
+}
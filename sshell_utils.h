@@ -1,6 +1,11 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,6 +20,20 @@
 #define OVERWRITE '>'
 #define PIPE '|'
 
+/*
+ * Number of standard descriptors (stdin, stdout and stderr) that a client passes with each command line in server mode
+ */
+#define SERVE_NUM_FDS 3
+
+/*
+ * Results of copyFileData: copied, or failed on the input or on the output
+ */
+enum CopyResults {
+	COPY_DONE,
+	COPY_READ_FAILED,
+	COPY_WRITE_FAILED
+};
+
 /*
  * Output options: printing to stdout, and writing or appending to an output file
  */
@@ -35,12 +54,39 @@ enum ParseErrors{
 	TOO_MANY_ARGUMENTS
 };
 
+/*
+ * Reply sent back to a client for each command line in server mode: the exit status of every command,
+ * and whether the command line asked the shell to exit
+ */
+struct ServeReply {
+	int numStatuses;
+	int statuses[MAX_ARGUMENTS];
+	int exitRequested;
+};
+
 /*
  * Struct that represents a single command, that is separated from other commands by pipes or redirects
  */
 struct Parameter {
 	char * parameterName;
 	char ** arguments;
+	char * executablePath;
+};
+
+/*
+ * A command line read from the input, along with its parse result: its Parameters, redirects and arguments when it parsed
+ * without errors, or no Parameters when it is empty
+ */
+struct ParsedLine {
+	char input[CMDLINE_MAX];
+	char cmd[CMDLINE_MAX];
+	int parseRetval;
+	struct Parameter ** parameters;
+	char * redirects;
+	char ** argArray;
+	int parameterCount;
+	long resolvedGeneration;
+	int resolvedPathEntries;
 };
 
 /*
@@ -115,11 +161,130 @@ char * getSubstring(char cmd[], int leftInc, int rightEx);
  */
 char ** parseArgs(char cmd[], int numArgs);
 
+/*
+ * Reads every entry of an open directory, skipping "." and "..", and passes each entry's stats to the visitor.
+ * Entries are stat'ed relative to dirfd, and the directory is read through a duplicate of dirfd, so the caller keeps ownership of it.
+ */
+int readDirectory(int dirfd, int statFlags, void (*visitEntry)(int dirfd, char * name, struct stat * entryStat, void * context), void * context);
+
 /*
  * Builtin sls command
  */
 int sls();
 
+/*
+ * Builtin sdu command: parallel recursive disk usage of each directory argument, or "." by default
+ */
+int sdu(struct Parameter * parameter);
+
+/*
+ * Builtin scount command: counts lines, words and bytes of each file, or of stdin by default
+ */
+int scount(struct Parameter * parameter);
+
+/*
+ * Builtin sgrep command: prints the lines of each file, or of stdin by default, that contain a fixed string
+ */
+int sgrep(struct Parameter * parameter);
+
+/*
+ * Copies the rest of the input to the output, from and to their current positions, with the cheapest method that works:
+ * copy_file_range between regular files, splice when either side is a pipe, sendfile from a regular file
+ * (such as to a socket), and read and write otherwise, including to outputs opened for appending.
+ * A method that fails, such as one the descriptors do not support, falls back to the next one, which continues from where
+ * it stopped, so that read and write tell which side failed. Returns COPY_READ_FAILED or COPY_WRITE_FAILED if the data
+ * cannot be copied, and COPY_DONE otherwise.
+ */
+int copyFileData(int infd, int outfd);
+
+/*
+ * Builtin scat command: writes each file, or stdin by default, to stdout, without copying the data through the process when possible
+ */
+int scat(struct Parameter * parameter);
+
+/*
+ * Builtin memo command: memo [--deps file... --] pipeline, or memo --stats.
+ * Replays the cached output and statuses of the pipeline when its inputs are unchanged, and runs and caches it otherwise.
+ * Prints the completed message of the pipeline itself, and returns the number of exit statuses stored in statuses.
+ */
+int memo(struct Parameter ** parameters, int parameterCount, int outputMode, char * outputFile, char * cmd, int statuses[]);
+
+/*
+ * Builtin bench command: bench [-n runs] [-w warmups] -- pipeline [-- pipeline...]
+ * Parses the pipelines once and runs them repeatedly with their output discarded, then prints the statistics of their times,
+ * to stdout or the output file. Prints a single completed message, and returns the number of exit statuses stored in statuses.
+ */
+int bench(struct Parameter ** parameters, int parameterCount, int outputMode, char * outputFile, char * cmd, int statuses[]);
+
+/*
+ * Builtin autopin command: autopin [on|off] turns automatic placement of pipeline stages on or off, or prints its state
+ */
+int autopin(struct Parameter * parameter);
+
+/*
+ * Turns autopin off and starts spreading pipelines from the first L3 cache domain again, as in a new shell
+ */
+void resetAutoPlacement();
+
+/*
+ * Parses a CPU list such as "0-3,8,10-11" into a CPU set. Returns 1 if the list is invalid or empty.
+ */
+int parseCPUList(char * list, cpu_set_t * cpus);
+
+/*
+ * Chooses a CPU set for every stage of a pipeline when autopin is on. All stages are placed in the same L3 cache domain,
+ * each on its own L2 cache (one core and its SMT siblings) in order, so that connected stages share the L3 cache.
+ * Successive pipelines go to successive L3 domains. Returns 0 if stages are not placed automatically.
+ */
+int planAutoPlacement(int numCommands, cpu_set_t stageCPUs[]);
+
+/*
+ * Applies the scheduling of a pipeline stage, in the stage's process before it runs:
+ * the options of a "pin [-n adjustment] [-i class[:level]] [cpulist] cmd..." prefix, which is removed from the stage,
+ * or else the automatically planned CPU set, if any. Returns 1 and prints an error if the stage cannot be placed.
+ */
+int applyStagePlacement(struct Parameter * parameter, cpu_set_t * plannedCPUs);
+
+/*
+ * Finds the time limit of a pipeline stage, from the "limit --time duration" prefixes among its limit and pin prefixes,
+ * which may come in any order, in milliseconds. Returns 0 if the stage has no valid time limit;
+ * invalid prefixes are reported by applyStageLimits and applyStagePlacement in the stage's process.
+ */
+long long getStageTimeout(struct Parameter * parameter);
+
+/*
+ * Applies the resource limits of a "limit [--time duration] [--mem size] [--nofile count] [--cpu seconds] cmd..." prefix,
+ * in the stage's process before it runs, and removes the prefix from the stage. The time limit itself is enforced by the shell.
+ * Returns 1 and prints an error if the prefix is invalid or a limit cannot be set.
+ */
+int applyStageLimits(struct Parameter * parameter);
+
+/*
+ * Current time on the monotonic clock, in milliseconds, which time limits count from
+ */
+long long monotonicMilliseconds();
+
+/*
+ * Checks that pidfds and timerfds, which waitWithTimeouts needs, are available, before a time-limited pipeline starts
+ */
+int timeLimitsSupported();
+
+/*
+ * Waits for every command of a pipeline, started at startTime on the monotonic clock, while enforcing the time limits
+ * of its stages, with one poll loop over a pidfd per command and a timerfd for the next deadline.
+ * When a stage's time runs out, every remaining command gets SIGTERM, then SIGKILL after LIMIT_KILL_DELAY_MS.
+ * The stage that timed out is reported with status LIMIT_TIMEOUT_STATUS, and the commands killed because of it with 128 plus the signal.
+ * If the descriptors cannot be created, such as when the shell runs out of them, the limits cannot be enforced,
+ * so the pipeline is killed right away, with an error.
+ */
+void waitWithTimeouts(pid_t childPIDs[], int numCommands, long long startTime, long long timeouts[], int statuses[]);
+
+/*
+ * Runs a builtin that can act as a pipeline stage, inside the stage's process instead of executing a program.
+ * Returns 1 and sets the builtin's exit status if the command is such a builtin, or 0 otherwise.
+ */
+int runStageBuiltin(struct Parameter * parameter, int * retval);
+
 /*
  * Builtin cd command
  */
@@ -136,11 +301,77 @@ int pwd();
 int getParametersAndRedirects(char cmd[], struct Parameter ** parameters[], char * redirects[], char ** argArray[], int * parameterCount);
 
 /*
- * Executes the entire pipeline
+ * Parses a command line, without its trailing newline, into a ParsedLine. Empty lines are left without Parameters.
+ */
+void parseCommandLine(char cmd[], struct ParsedLine * line);
+
+/*
+ * Deallocates the Parameters, redirects and arguments of a ParsedLine
+ */
+void freeParsedLine(struct ParsedLine * line);
+
+/*
+ * Sets the function run while the shell waits for a pipeline, after all of its commands are started
+ */
+void setPipelineWaitHook(void (*hook)());
+
+/*
+ * Skips or runs again the function run while the shell waits for a pipeline
  */
-void executePipeline(struct Parameter ** commands, int numCommands, char * cmd);
+void pausePipelineWaitHook(int paused);
+
+/*
+ * Runs the pipeline and waits for it, storing the wait status of every command in statuses.
+ * Returns 1 if the pipes or processes could not be created, or the time limits of its stages cannot be enforced.
+ */
+int runPipeline(struct Parameter ** commands, int numCommands, int statuses[]);
+
+/*
+ * Prints the completed message, followed by the exit statuses of all the processes
+ */
+void printCompleted(char * cmd, int statuses[], int numCommands);
+
+/*
+ * Executes the entire pipeline, with its output sent to stdout or to the output file, and prints its completed message.
+ * Stores the wait status of every command in statuses. Returns 1 if the pipeline could not be started.
+ */
+int executePipeline(struct Parameter ** commands, int numCommands, int outputMode, char * outputFile, char * cmd, int statuses[]);
+
+/*
+ * Opens the output file of a redirect, with truncate or append depending on the output mode, closed on exec
+ * so that commands only get it as their stdout. Returns the file descriptor, or -1 if the file cannot be opened.
+ */
+int openOutputFile(int outputMode, char * outputFile);
 
 /*
  * Redirect stdout, with the given parameters
  */
-int stdoutRedirect(int outputMode, char * outputFile);
\ No newline at end of file
+int stdoutRedirect(int outputMode, char * outputFile);
+
+/*
+ * Parses and runs a single command line, printing its completed message.
+ * Stores the exit status of every command in statuses, and returns 1 if the shell should exit.
+ */
+int executeCommandLine(char cmd[], int statuses[], int * numStatuses);
+
+/*
+ * Runs a single parsed command line, printing its completed message.
+ * Stores the exit status of every command in statuses, and returns 1 if the shell should exit.
+ */
+int executeParsedLine(struct ParsedLine * line, int statuses[], int * numStatuses);
+
+/*
+ * Starts reading stdin in batch mode, parsing up to $SSHELL_LOOKAHEAD lines ahead, or LOOKAHEAD_DEFAULT_LINES, while pipelines run
+ */
+void startLookAhead();
+
+/*
+ * Returns the next line in batch mode, parsed ahead of time when it was already read, or NULL at the end of the input.
+ * The line stays valid until the next call.
+ */
+struct ParsedLine * nextLookAheadLine();
+
+/*
+ * Command server mode: accepts clients on a Unix socket, and runs the command lines they send with their own standard descriptors
+ */
+int serveCommands(char * socketPath);